@@ -0,0 +1,374 @@
+#ifndef AUGMENTED_AVL_H
+#define AUGMENTED_AVL_H
+
+#include <algorithm>
+#include <limits>
+#include "avlbst.h"
+
+/**
+ * Monoids for AugmentedAVLTree. A monoid provides
+ *   typedef ... result_type;
+ *   result_type identity() const;
+ *   result_type combine(const result_type& a, const result_type& b) const;
+ *   result_type lift(const Key& key, const Value& value) const;
+ * combine must be associative and identity must be its neutral element.
+ * It does not need to be commutative -- results are always combined in
+ * key order.
+ */
+template <typename T>
+struct SumMonoid
+{
+    typedef T result_type;
+    T identity() const { return T(); }
+    T combine(const T &a, const T &b) const { return a + b; }
+    template <typename Key>
+    T lift(const Key &, const T &value) const { return value; }
+};
+
+template <typename T>
+struct MinMonoid
+{
+    typedef T result_type;
+    T identity() const { return std::numeric_limits<T>::max(); }
+    T combine(const T &a, const T &b) const { return std::min(a, b); }
+    template <typename Key>
+    T lift(const Key &, const T &value) const { return value; }
+};
+
+template <typename T>
+struct MaxMonoid
+{
+    typedef T result_type;
+    T identity() const { return std::numeric_limits<T>::lowest(); }
+    T combine(const T &a, const T &b) const { return std::max(a, b); }
+    template <typename Key>
+    T lift(const Key &, const T &value) const { return value; }
+};
+
+/**
+ * An AVL node that also stores the monoid aggregate of its whole subtree.
+ */
+template <typename Key, typename Value, typename Monoid>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    typedef typename Monoid::result_type Aggregate;
+
+    AugmentedAVLNode(const Key &key, const Value &value, AugmentedAVLNode *parent, const Aggregate &aggregate);
+    virtual ~AugmentedAVLNode();
+
+    const Aggregate &getAggregate() const;
+    void setAggregate(const Aggregate &aggregate);
+
+    virtual AugmentedAVLNode *getParent() const override;
+    virtual AugmentedAVLNode *getLeft() const override;
+    virtual AugmentedAVLNode *getRight() const override;
+
+protected:
+    Aggregate aggregate_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AugmentedAVLNode class.
+  -------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Monoid>
+AugmentedAVLNode<Key, Value, Monoid>::AugmentedAVLNode(const Key &key, const Value &value, AugmentedAVLNode *parent, const Aggregate &aggregate)
+    : AVLNode<Key, Value>(key, value, parent), aggregate_(aggregate)
+{
+}
+
+template <typename Key, typename Value, typename Monoid>
+AugmentedAVLNode<Key, Value, Monoid>::~AugmentedAVLNode()
+{
+}
+
+template <typename Key, typename Value, typename Monoid>
+const typename AugmentedAVLNode<Key, Value, Monoid>::Aggregate &AugmentedAVLNode<Key, Value, Monoid>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLNode<Key, Value, Monoid>::setAggregate(const Aggregate &aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+template <typename Key, typename Value, typename Monoid>
+AugmentedAVLNode<Key, Value, Monoid> *AugmentedAVLNode<Key, Value, Monoid>::getParent() const
+{
+    return static_cast<AugmentedAVLNode *>(this->parent_);
+}
+
+template <typename Key, typename Value, typename Monoid>
+AugmentedAVLNode<Key, Value, Monoid> *AugmentedAVLNode<Key, Value, Monoid>::getLeft() const
+{
+    return static_cast<AugmentedAVLNode *>(this->left_);
+}
+
+template <typename Key, typename Value, typename Monoid>
+AugmentedAVLNode<Key, Value, Monoid> *AugmentedAVLNode<Key, Value, Monoid>::getRight() const
+{
+    return static_cast<AugmentedAVLNode *>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AugmentedAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+ * An AVL tree that keeps a monoid aggregate of every subtree, so the
+ * aggregate of any key range comes back in O(log n).
+ *
+ * Values must only change through insert(): the non-const operator[] is
+ * hidden, and writing through an iterator leaves the aggregates stale.
+ */
+template <typename Key, typename Value, typename Monoid>
+class AugmentedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef AugmentedAVLNode<Key, Value, Monoid> AugNode;
+    typedef typename Monoid::result_type Aggregate;
+
+    AugmentedAVLTree(const Monoid &monoid = Monoid());
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    using AVLTree<Key, Value>::insert;
+
+    // aggregate of every value with lo <= key <= hi
+    Aggregate aggregate(const Key &lo, const Key &hi) const;
+    // aggregate of the whole tree
+    Aggregate aggregate() const;
+
+    Value const &operator[](const Key &key) const;
+
+protected:
+    virtual void linkNode(Node<Key, Value> *node);
+    virtual void unlinkNode(Node<Key, Value> *node);
+    virtual void builtNode(Node<Key, Value> *node, int leftHeight, int rightHeight);
+    virtual void nodeSwap(AVLNode<Key, Value> *n1, AVLNode<Key, Value> *n2);
+    virtual AVLNode<Key, Value> *createNode(const Key &key, const Value &value, Node<Key, Value> *parent);
+    virtual void rotated(AVLNode<Key, Value> *lowered);
+
+    Aggregate subtreeAggregate(AugNode *node) const;
+    void pull(AugNode *node);
+    void pullToRoot(AugNode *node);
+
+    Monoid monoid_;
+};
+
+template <typename Key, typename Value, typename Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::AugmentedAVLTree(const Monoid &monoid) : monoid_(monoid)
+{
+}
+
+template <typename Key, typename Value, typename Monoid>
+AVLNode<Key, Value> *AugmentedAVLTree<Key, Value, Monoid>::createNode(const Key &key, const Value &value, Node<Key, Value> *parent)
+{
+    return new AugNode(key, value, static_cast<AugNode *>(parent), monoid_.lift(key, value));
+}
+
+/**
+ * Aggregate of a (possibly empty) subtree.
+ */
+template <typename Key, typename Value, typename Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid>::subtreeAggregate(AugNode *node) const
+{
+    return node == nullptr ? monoid_.identity() : node->getAggregate();
+}
+
+/**
+ * Recomputes one node's aggregate from its children's.
+ */
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pull(AugNode *node)
+{
+    Aggregate mid = monoid_.lift(node->getKey(), node->getValue());
+    node->setAggregate(monoid_.combine(monoid_.combine(subtreeAggregate(node->getLeft()), mid),
+                                       subtreeAggregate(node->getRight())));
+}
+
+/**
+ * Recomputes the aggregates from node up to the root.
+ */
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pullToRoot(AugNode *node)
+{
+    while (node != nullptr)
+    {
+        pull(node);
+        node = node->getParent();
+    }
+}
+
+/*
+ * Rotations only move two nodes, so only those two need refreshing --
+ * the lower one first. Any staleness below them (the fixups run before
+ * the path is refreshed) is repaired by the pullToRoot() that ends every
+ * insert and remove, since it passes through both again.
+ */
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::rotated(AVLNode<Key, Value> *lowered)
+{
+    pull(static_cast<AugNode *>(lowered));
+    pull(static_cast<AugNode *>(lowered->getParent()));
+}
+
+/*
+ * The subtree at each position keeps the same contents after a swap, so
+ * the aggregates stay with the positions.
+ */
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::nodeSwap(AVLNode<Key, Value> *n1, AVLNode<Key, Value> *n2)
+{
+    AVLTree<Key, Value>::nodeSwap(n1, n2);
+    AugNode *a1 = static_cast<AugNode *>(n1);
+    AugNode *a2 = static_cast<AugNode *>(n2);
+    Aggregate temp = a1->getAggregate();
+    a1->setAggregate(a2->getAggregate());
+    a2->setAggregate(temp);
+}
+
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::insert(const std::pair<const Key, Value> &new_item)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_INSERT);
+    AugNode *existing = static_cast<AugNode *>(this->internalFind(new_item.first));
+    if (existing != nullptr)
+    {
+        existing->setValue(new_item.second);
+        pullToRoot(existing);
+        return;
+    }
+    linkNode(createNode(new_item.first, new_item.second, nullptr));
+}
+
+/*
+ * A node moved in from another tree still has that tree's aggregate, so
+ * the pull starts at the node itself.
+ */
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::linkNode(Node<Key, Value> *node)
+{
+    AVLTree<Key, Value>::linkNode(node);
+    pullToRoot(static_cast<AugNode *>(node));
+}
+
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::unlinkNode(Node<Key, Value> *removed)
+{
+    AugNode *node = static_cast<AugNode *>(removed);
+    // lowest node that survives and loses an element from its subtree
+    AugNode *start = node->getParent();
+    if (node->getLeft() != nullptr && node->getRight() != nullptr)
+    {
+        AugNode *pred = static_cast<AugNode *>(this->predecessor(node));
+        // after the swap pred sits where node was, right above it
+        start = (pred->getParent() == node) ? pred : pred->getParent();
+    }
+    AVLTree<Key, Value>::unlinkNode(node);
+    pullToRoot(start);
+}
+
+// children are complete by now, so one pull() per node is enough
+template <typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::builtNode(Node<Key, Value> *node, int leftHeight, int rightHeight)
+{
+    AVLTree<Key, Value>::builtNode(node, leftHeight, rightHeight);
+    pull(static_cast<AugNode *>(node));
+}
+
+/**
+ * Splits at the highest node inside [lo, hi]. Below it, the path towards
+ * lo picks up whole right subtrees and the path towards hi picks up whole
+ * left subtrees, so only two root-to-leaf paths are visited.
+ */
+template <typename Key, typename Value, typename Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid>::aggregate(const Key &lo, const Key &hi) const
+{
+    AugNode *split = static_cast<AugNode *>(this->root_);
+    while (split != nullptr)
+    {
+        if (split->getKey() < lo)
+        {
+            split = split->getRight();
+        }
+        else if (hi < split->getKey())
+        {
+            split = split->getLeft();
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (split == nullptr)
+    {
+        return monoid_.identity();
+    }
+
+    // left boundary -- everything found later is smaller, so prepend
+    Aggregate leftAcc = monoid_.identity();
+    AugNode *curr = split->getLeft();
+    while (curr != nullptr)
+    {
+        if (curr->getKey() < lo)
+        {
+            curr = curr->getRight();
+        }
+        else
+        {
+            Aggregate here = monoid_.combine(monoid_.lift(curr->getKey(), curr->getValue()),
+                                             subtreeAggregate(curr->getRight()));
+            leftAcc = monoid_.combine(here, leftAcc);
+            curr = curr->getLeft();
+        }
+    }
+
+    // right boundary -- everything found later is larger, so append
+    Aggregate rightAcc = monoid_.identity();
+    curr = split->getRight();
+    while (curr != nullptr)
+    {
+        if (hi < curr->getKey())
+        {
+            curr = curr->getLeft();
+        }
+        else
+        {
+            Aggregate here = monoid_.combine(subtreeAggregate(curr->getLeft()),
+                                             monoid_.lift(curr->getKey(), curr->getValue()));
+            rightAcc = monoid_.combine(rightAcc, here);
+            curr = curr->getRight();
+        }
+    }
+
+    Aggregate mid = monoid_.lift(split->getKey(), split->getValue());
+    return monoid_.combine(monoid_.combine(leftAcc, mid), rightAcc);
+}
+
+template <typename Key, typename Value, typename Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid>::aggregate() const
+{
+    return subtreeAggregate(static_cast<AugNode *>(this->root_));
+}
+
+/**
+ * Read-only lookup; writes have to go through insert() so the aggregates
+ * along the path get refreshed.
+ */
+template <typename Key, typename Value, typename Monoid>
+Value const &AugmentedAVLTree<Key, Value, Monoid>::operator[](const Key &key) const
+{
+    return BinarySearchTree<Key, Value>::operator[](key);
+}
+
+#endif
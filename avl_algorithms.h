@@ -0,0 +1,363 @@
+#ifndef AVL_ALGORITHMS_H
+#define AVL_ALGORITHMS_H
+
+/**
+ * AVL rebalancing written against an abstract node "handle", so trees with
+ * their own node layouts (AVLTree's virtual nodes, key-only nodes,
+ * index-linked node pools) share one implementation.
+ *
+ * The Ops object tells the algorithms how to follow and change links:
+ *   typedef ... Handle;
+ *   Handle nil() const;
+ *   Handle parent(Handle n) const;   void setParent(Handle n, Handle p);
+ *   Handle left(Handle n) const;     void setLeft(Handle n, Handle l);
+ *   Handle right(Handle n) const;    void setRight(Handle n, Handle r);
+ *   int balance(Handle n) const;     void setBalance(Handle n, int b);
+ *   Handle root() const;             void setRoot(Handle r);
+ *   void rotated(Handle n);          n just moved down a level in a rotation
+ *   void fixStep();                  a fix-up loop moved up a level
+ * Balances are height(right) - height(left), and only -1, 0 and 1 are
+ * ever passed to setBalance(). The two hooks are for trees that count
+ * events or keep per-node data that a rotation invalidates; the others
+ * leave them empty.
+ */
+template <typename Ops>
+struct AVLAlgorithms
+{
+    typedef typename Ops::Handle Handle;
+
+    static Handle leftmost(const Ops &ops, Handle n)
+    {
+        if (n == ops.nil())
+        {
+            return n;
+        }
+        while (ops.left(n) != ops.nil())
+        {
+            n = ops.left(n);
+        }
+        return n;
+    }
+
+    static Handle rightmost(const Ops &ops, Handle n)
+    {
+        if (n == ops.nil())
+        {
+            return n;
+        }
+        while (ops.right(n) != ops.nil())
+        {
+            n = ops.right(n);
+        }
+        return n;
+    }
+
+    static Handle successor(const Ops &ops, Handle n)
+    {
+        if (ops.right(n) != ops.nil())
+        {
+            return leftmost(ops, ops.right(n));
+        }
+        Handle p = ops.parent(n);
+        while (p != ops.nil() && n == ops.right(p))
+        {
+            n = p;
+            p = ops.parent(p);
+        }
+        return p;
+    }
+
+    static Handle predecessor(const Ops &ops, Handle n)
+    {
+        if (ops.left(n) != ops.nil())
+        {
+            return rightmost(ops, ops.left(n));
+        }
+        Handle p = ops.parent(n);
+        while (p != ops.nil() && n == ops.left(p))
+        {
+            n = p;
+            p = ops.parent(p);
+        }
+        return p;
+    }
+
+    // points whatever held oldChild (a parent or the root) at newChild
+    static void replaceChild(Ops &ops, Handle parent, Handle oldChild, Handle newChild)
+    {
+        if (parent == ops.nil())
+        {
+            ops.setRoot(newChild);
+        }
+        else if (ops.left(parent) == oldChild)
+        {
+            ops.setLeft(parent, newChild);
+        }
+        else
+        {
+            ops.setRight(parent, newChild);
+        }
+        if (newChild != ops.nil())
+        {
+            ops.setParent(newChild, parent);
+        }
+    }
+
+    static void rotateLeft(Ops &ops, Handle n)
+    {
+        Handle r = ops.right(n);
+        Handle inner = ops.left(r);
+        replaceChild(ops, ops.parent(n), n, r);
+        ops.setRight(n, inner);
+        if (inner != ops.nil())
+        {
+            ops.setParent(inner, n);
+        }
+        ops.setLeft(r, n);
+        ops.setParent(n, r);
+        ops.rotated(n);
+    }
+
+    static void rotateRight(Ops &ops, Handle n)
+    {
+        Handle l = ops.left(n);
+        Handle inner = ops.right(l);
+        replaceChild(ops, ops.parent(n), n, l);
+        ops.setLeft(n, inner);
+        if (inner != ops.nil())
+        {
+            ops.setParent(inner, n);
+        }
+        ops.setRight(l, n);
+        ops.setParent(n, l);
+        ops.rotated(n);
+    }
+
+    /**
+     * Restores the AVL property after leaf n was linked in with balance 0.
+     * At most one single or double rotation happens.
+     */
+    static void insertFix(Ops &ops, Handle n)
+    {
+        Handle p = ops.parent(n);
+        while (p != ops.nil())
+        {
+            ops.fixStep();
+            // +-2 is never stored, so balances fit in two bits
+            int bal = ops.balance(p) + (ops.left(p) == n ? -1 : 1);
+            if (bal == 0)
+            {
+                ops.setBalance(p, 0);
+                return;
+            }
+            if (bal == -1 || bal == 1)
+            {
+                ops.setBalance(p, bal);
+                n = p;
+                p = ops.parent(p);
+                continue;
+            }
+            if (bal == -2)
+            {
+                if (ops.balance(n) == -1)
+                {
+                    // zig-zig
+                    rotateRight(ops, p);
+                    ops.setBalance(p, 0);
+                    ops.setBalance(n, 0);
+                }
+                else
+                {
+                    // zig-zag
+                    Handle g = ops.right(n);
+                    int gb = ops.balance(g);
+                    rotateLeft(ops, n);
+                    rotateRight(ops, p);
+                    ops.setBalance(p, gb == -1 ? 1 : 0);
+                    ops.setBalance(n, gb == 1 ? -1 : 0);
+                    ops.setBalance(g, 0);
+                }
+            }
+            else
+            {
+                if (ops.balance(n) == 1)
+                {
+                    rotateLeft(ops, p);
+                    ops.setBalance(p, 0);
+                    ops.setBalance(n, 0);
+                }
+                else
+                {
+                    Handle g = ops.left(n);
+                    int gb = ops.balance(g);
+                    rotateRight(ops, n);
+                    rotateLeft(ops, p);
+                    ops.setBalance(p, gb == 1 ? -1 : 0);
+                    ops.setBalance(n, gb == -1 ? 1 : 0);
+                    ops.setBalance(g, 0);
+                }
+            }
+            return;
+        }
+    }
+
+    /**
+     * Restores the AVL property after one side of n got shorter
+     * (leftShrunk tells which), walking up while the height keeps dropping.
+     */
+    static void removeFix(Ops &ops, Handle n, bool leftShrunk)
+    {
+        while (n != ops.nil())
+        {
+            ops.fixStep();
+            Handle parent = ops.parent(n);
+            bool nextLeft = (parent != ops.nil() && ops.left(parent) == n);
+            int bal = ops.balance(n) + (leftShrunk ? 1 : -1);
+
+            if (bal == -1 || bal == 1)
+            {
+                // height unchanged -- done
+                ops.setBalance(n, bal);
+                return;
+            }
+            if (bal == 2)
+            {
+                Handle c = ops.right(n);
+                int cb = ops.balance(c);
+                if (cb == 0)
+                {
+                    rotateLeft(ops, n);
+                    ops.setBalance(n, 1);
+                    ops.setBalance(c, -1);
+                    return;
+                }
+                if (cb == 1)
+                {
+                    rotateLeft(ops, n);
+                    ops.setBalance(n, 0);
+                    ops.setBalance(c, 0);
+                }
+                else
+                {
+                    Handle g = ops.left(c);
+                    int gb = ops.balance(g);
+                    rotateRight(ops, c);
+                    rotateLeft(ops, n);
+                    ops.setBalance(n, gb == 1 ? -1 : 0);
+                    ops.setBalance(c, gb == -1 ? 1 : 0);
+                    ops.setBalance(g, 0);
+                }
+            }
+            else if (bal == -2)
+            {
+                Handle c = ops.left(n);
+                int cb = ops.balance(c);
+                if (cb == 0)
+                {
+                    rotateRight(ops, n);
+                    ops.setBalance(n, -1);
+                    ops.setBalance(c, 1);
+                    return;
+                }
+                if (cb == -1)
+                {
+                    rotateRight(ops, n);
+                    ops.setBalance(n, 0);
+                    ops.setBalance(c, 0);
+                }
+                else
+                {
+                    Handle g = ops.right(c);
+                    int gb = ops.balance(g);
+                    rotateLeft(ops, c);
+                    rotateRight(ops, n);
+                    ops.setBalance(n, gb == -1 ? 1 : 0);
+                    ops.setBalance(c, gb == 1 ? -1 : 0);
+                    ops.setBalance(g, 0);
+                }
+            }
+            else
+            {
+                ops.setBalance(n, 0);
+            }
+            // this subtree got shorter, so its parent's side did too
+            n = parent;
+            leftShrunk = nextLeft;
+        }
+    }
+
+    /**
+     * Links node n (balance 0, no children) in as the left or right child
+     * of parent, or as the root when parent is nil, and rebalances.
+     */
+    static void insertAt(Ops &ops, Handle parent, bool asLeft, Handle n)
+    {
+        ops.setParent(n, parent);
+        ops.setLeft(n, ops.nil());
+        ops.setRight(n, ops.nil());
+        ops.setBalance(n, 0);
+        if (parent == ops.nil())
+        {
+            ops.setRoot(n);
+            return;
+        }
+        if (asLeft)
+        {
+            ops.setLeft(parent, n);
+        }
+        else
+        {
+            ops.setRight(parent, n);
+        }
+        insertFix(ops, n);
+    }
+
+    /**
+     * Unlinks z and rebalances. A node with two children is replaced by its
+     * predecessor, as in avlbst.h, but by relinking rather than swapping
+     * (AVLTree swaps, then unlinks and calls removeFix() itself).
+     * z itself is left for the caller to free.
+     */
+    static void erase(Ops &ops, Handle z)
+    {
+        Handle fix;
+        bool leftShrunk;
+        if (ops.left(z) != ops.nil() && ops.right(z) != ops.nil())
+        {
+            Handle y = rightmost(ops, ops.left(z));
+            if (ops.parent(y) == z)
+            {
+                // y keeps its left subtree and moves up one level
+                fix = y;
+                leftShrunk = true;
+            }
+            else
+            {
+                fix = ops.parent(y);
+                leftShrunk = false;
+                Handle yl = ops.left(y);
+                ops.setRight(fix, yl);
+                if (yl != ops.nil())
+                {
+                    ops.setParent(yl, fix);
+                }
+                ops.setLeft(y, ops.left(z));
+                ops.setParent(ops.left(z), y);
+            }
+            ops.setRight(y, ops.right(z));
+            ops.setParent(ops.right(z), y);
+            ops.setBalance(y, ops.balance(z));
+            replaceChild(ops, ops.parent(z), z, y);
+        }
+        else
+        {
+            Handle child = (ops.left(z) != ops.nil()) ? ops.left(z) : ops.right(z);
+            fix = ops.parent(z);
+            leftShrunk = (fix != ops.nil() && ops.left(fix) == z);
+            replaceChild(ops, fix, z, child);
+        }
+        removeFix(ops, fix, leftShrunk);
+    }
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <algorithm>
 #include "bst.h"
+#include "avl_algorithms.h"
 
 struct KeyError
 {
@@ -128,18 +129,51 @@ template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    explicit AVLTree(bool allowDuplicates = false, bool threaded = false);
     virtual void insert(const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key &key);                              // TODO
+    // keeps insert(node_type&&) visible
+    using BinarySearchTree<Key, Value>::insert;
+    virtual void rebalance();
 protected:
+    virtual void linkNode(Node<Key, Value> *node);
+    virtual void unlinkNode(Node<Key, Value> *node);                   // TODO
+    virtual void builtNode(Node<Key, Value> *node, int leftHeight, int rightHeight);
     virtual void nodeSwap(AVLNode<Key, Value> *n1, AVLNode<Key, Value> *n2);
+    virtual AVLNode<Key, Value> *createNode(const Key &key, const Value &value, Node<Key, Value> *parent);
 
     // Add helper functions here
-    void rotateRight(AVLNode<Key, Value> *curr);
-    void rotateLeft(AVLNode<Key, Value> *curr);
+    // called with the node a rotation moved down, so augmented trees can
+    // refresh per-node data
+    virtual void rotated(AVLNode<Key, Value> *lowered);
 
-    // help with insert and remove
-    void insertFix(AVLNode<Key, Value> *parent, AVLNode<Key, Value> *curr);
-    virtual void removeFix(AVLNode<Key, Value> *curr, int8_t diff);
+    // link access for AVLAlgorithms, which does the rebalancing for
+    // insert and remove
+    struct Ops
+    {
+        typedef AVLNode<Key, Value> *Handle;
+        AVLTree *tree_;
+
+        explicit Ops(AVLTree *tree) : tree_(tree) {}
+
+        Handle nil() const { return nullptr; }
+        Handle parent(Handle n) const { return n->getParent(); }
+        Handle left(Handle n) const { return n->getLeft(); }
+        Handle right(Handle n) const { return n->getRight(); }
+        int balance(Handle n) const { return n->getBalance(); }
+        void setParent(Handle n, Handle p) { n->setParent(p); }
+        void setLeft(Handle n, Handle l) { n->setLeft(l); }
+        void setRight(Handle n, Handle r) { n->setRight(r); }
+        void setBalance(Handle n, int b) { n->setBalance((int8_t)b); }
+        Handle root() const { return static_cast<Handle>(tree_->root_); }
+        void setRoot(Handle r) { tree_->root_ = r; }
+        void rotated(Handle n)
+        {
+            tree_->countRotation();
+            tree_->rotated(n);
+        }
+        void fixStep() { tree_->countFixStep(); }
+    };
+    typedef AVLAlgorithms<Ops> Algo;
 
     // helper that inherit search and predecessor
     AVLNode<Key, Value> *internalFind(const Key &key) const;
@@ -152,6 +186,15 @@ protected:
     */
 };
 
+/*
+ * allowDuplicates turns on multimap mode and threaded the in-order
+ * next/prev links, see BinarySearchTree.
+ */
+template <class Key, class Value>
+AVLTree<Key, Value>::AVLTree(bool allowDuplicates, bool threaded) : BinarySearchTree<Key, Value>(allowDuplicates, threaded)
+{
+}
+
 template <class Key, class Value>
 AVLNode<Key, Value> *AVLTree<Key, Value>::internalFind(const Key &key) const
 {
@@ -164,76 +207,19 @@ AVLNode<Key, Value> *AVLTree<Key, Value>::predecessor(AVLNode<Key, Value> *curre
     return (static_cast<AVLNode<Key, Value> *>(BinarySearchTree<Key, Value>::predecessor(current)));
 }
 
-// zig - zig
 template <class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value> *curr)
+AVLNode<Key, Value> *AVLTree<Key, Value>::createNode(const Key &key, const Value &value, Node<Key, Value> *parent)
 {
-    AVLNode<Key, Value> *currParent = curr->getParent();
-    AVLNode<Key, Value> *currRside = curr->getRight();
-
-    currRside->setParent(currParent);
-
-    if (currParent == nullptr)
+    if (this->threaded_)
     {
-        this->root_ = currRside;
-    }
-    // update it
-    else if (currParent->getLeft() == curr)
-    {
-        currParent->setLeft(currRside);
-    }
-    else
-    {
-        currParent->setRight(currRside);
-    }
-
-    //  update everything else
-    AVLNode<Key, Value> *currRchild = currRside->getLeft();
-    currRside->setLeft(curr);
-    curr->setParent(currRside);
-
-    curr->setRight(currRchild);
-    // avoid seg fault
-    if (currRchild != nullptr)
-    {
-        currRchild->setParent(curr);
+        return new ThreadedNode<Key, Value, AVLNode<Key, Value> >(key, value, static_cast<AVLNode<Key, Value> *>(parent));
     }
+    return new AVLNode<Key, Value>(key, value, static_cast<AVLNode<Key, Value> *>(parent));
 }
 
-// zig - zig -- same as left rotate function
 template <class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value> *curr)
+void AVLTree<Key, Value>::rotated(AVLNode<Key, Value> *)
 {
-    // official left node
-    AVLNode<Key, Value> *currParent = curr->getParent();
-    AVLNode<Key, Value> *currLside = curr->getLeft();
-
-    currLside->setParent(currParent);
-
-    // set the new root ensure by using this!
-    if (currParent == nullptr) 
-    {
-        this->root_ = currLside;
-    }
-    else if (currParent->getRight() == curr)
-    {
-        currParent->setRight(currLside);
-    }
-    else
-    {
-        currParent->setLeft(currLside);
-    }
-    // adjust the parents and children and nodes shift accordingly
-    AVLNode<Key, Value> *currLchild = currLside->getRight();
-    currLside->setRight(curr);
-    curr->setParent(currLside);
-
-    curr->setLeft(currLchild);
-    // avoid seg fault
-    if (currLchild != nullptr)
-    {
-        currLchild->setParent(curr);
-    }
 }
 
 /*
@@ -243,21 +229,35 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value> *curr)
 template <typename Key, typename Value>
 void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
 {
-    // create a new node
-    AVLNode<Key, Value> *insertNode = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-
-    if (this->root_ == NULL)
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_INSERT);
+    // find item -- if it exists overwrite current value with the updated value
+    // key exists (multimap mode adds the new one after it instead)
+    AVLNode<Key, Value> *existing = this->multi_ ? nullptr : internalFind(new_item.first);
+    if (existing != nullptr)
     {
-        this->root_ = insertNode;
+        existing->setValue(new_item.second);
         return;
     }
+    linkNode(createNode(new_item.first, new_item.second, nullptr));
+}
 
-    // find item -- if it exists overwrite current value with the updated value
-    // key exists
-    if (internalFind(new_item.first) != nullptr)
+/*
+ * Links a detached node in as a new leaf and rebalances.
+ */
+template <typename Key, typename Value>
+void AVLTree<Key, Value>::linkNode(Node<Key, Value> *node)
+{
+    AVLNode<Key, Value> *insertNode = static_cast<AVLNode<Key, Value> *>(node);
+    insertNode->setParent(nullptr);
+    insertNode->setLeft(nullptr);
+    insertNode->setRight(nullptr);
+    insertNode->setBalance(0);
+
+    if (this->root_ == NULL)
     {
-        internalFind(new_item.first)->setValue(new_item.second);
-        delete insertNode;
+        this->root_ = insertNode;
+        this->nodeLinked(insertNode);
+        this->size_ = 1;
         return;
     }
 
@@ -265,8 +265,10 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
 
     while (true)
     {
+        this->countVisit();
+        this->countComparison();
         // go to the left if the insert data is less than
-        if (new_item.first < currNode->getKey())
+        if (insertNode->getKey() < currNode->getKey())
         {
             // check if anything is the the left, if not insert
             if (currNode->getLeft() == nullptr)
@@ -299,151 +301,11 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
             }
         }
     }
+    this->nodeLinked(insertNode);
+    this->size_++;
 
-        // CHECK IN SMALL LEVEL -- CURRNODE and INSERT NODE accounted for only
-    // within the requirement of -1 or 1 and add element on either side then new balance = 0
-    // only inserting to curr left or right side
-    if (currNode->getBalance() == 1 || currNode->getBalance() == -1)
-    {
-        currNode->setBalance(0);
-        return;
-    }
-    // adding item to either side will change the balance
-    else if (currNode->getBalance() == 0)
-    {
-        // left side exists (right - left = 0-1 = -1)
-        if (currNode->getLeft() == insertNode)
-        {
-            currNode->setBalance(-1);
-        }
-        else
-        {
-            // right - left = 1-0
-            currNode->setBalance(1);
-        }
-        insertFix(currNode, insertNode);
-    }
-}
-
-/*  
-    parent -- referes to the inserted node parent
-    curr -- referes to inserted node
-*/
-
-template <class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value> *parent, AVLNode<Key, Value> *curr)
-{
-    // BIG PICTURE -- CHECK ALL BALANCE FACTORS now
-    // necessary steps for rebalancing -- zig-zig or zig-zag  --- insertFix(newNode, parent)
-    // Edge case: nothing to rebalance
-    if (parent == nullptr || parent->getParent() == nullptr)
-    {
-        return;
-    }
-
-    // continue with rotations -- grandparent
-    AVLNode<Key, Value> *grand = parent->getParent();
-
-    // check leftside first
-    if (grand->getLeft() == parent)
-    {
-        // update the balance factor for everything else
-        grand->updateBalance(-1);
-        // exit if it's all balanced already
-        if (grand->getBalance() == 0)
-        {
-            return;
-        }
-        else if (grand->getBalance() == -1)
-        {
-            insertFix(grand, parent);
-            return;
-        }
-        //balance is -2
-        else if (grand->getBalance() == -2)
-        {
-            // need to figure out which side the insertNode is
-            if (parent -> getBalance() == -1) // zig-zig -- rotate right
-            {
-                rotateRight(grand);
-                grand->setBalance(0);
-                parent->setBalance(0);
-            }
-            else // zig-zag needed -- rotate left then right
-            {
-                rotateLeft(parent);
-                rotateRight(grand);
-
-                // check over inserted node -- is it balanced? to begin with
-                if (curr->getBalance() == 0)
-                {
-                    grand->setBalance(0);
-                    parent->setBalance(0);
-                }
-                // need example of this
-                else if (curr->getBalance() == -1)
-                {
-                    grand->setBalance(1);
-                    parent->setBalance(0);
-                }
-                else if (curr->getBalance() == 1)
-                {
-                    grand->setBalance(0);
-                    parent->setBalance(-1);
-                }
-                curr->setBalance(0);
-            }
-        }
-    }
-    else 
-    {
-        // update the balance factor for everything else
-        grand->updateBalance(1);
-        // exit if it's all balanced now -- right side is also balanced
-        if (grand->getBalance() == 0)
-        {
-            return;
-        }
-        else if (grand->getBalance() == 1)
-        {
-            insertFix(grand, parent);
-            return;
-        }
-        else if (grand->getBalance() == 2)
-        {
-            // need to figure out which side the insertNode is
-            if (parent -> getBalance() == 1) // zig-zig -- rotate rightparent->getRight() == curr
-            {
-                rotateLeft(grand);
-                grand->setBalance(0);
-                parent->setBalance(0);
-            }
-            else if (parent->getBalance() == -1) // zig-zag needed -- rotate left then right
-            {
-                rotateRight(parent);
-                rotateLeft(grand);
-
-                // check before the rotation occurs
-                if (curr->getBalance() == 0)
-                {
-                    grand->setBalance(0);
-                    parent->setBalance(0);
-                }
-                else if (curr->getBalance() == -1)
-                {
-                    grand->setBalance(0);
-                    parent->setBalance(1);
-                }
-                // right is greater than left after rotation 
-                else if (curr->getBalance() == 1)
-                {
-                    grand->setBalance(-1);
-                    parent->setBalance(0);
-                }
-                curr->setBalance(0);
-            }
-        }
-    }
+    Ops ops(this);
+    Algo::insertFix(ops, insertNode);
 }
 
 /*
@@ -452,177 +314,11 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value> *parent, AVLNode<Key, Va
  */
 
 template <class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value> *curr, int8_t diff) // Look at balance later
+void AVLTree<Key, Value>::unlinkNode(Node<Key, Value> *node)
 {
     // TODO
-    // be aware of rotation and rebalance -- use predecessor
-
-    // If curr is null, return
-    if (curr == nullptr)
-    { 
-        return;
-    }
-    // Compute parent(node) and ndiff (for next recursive call)
-    AVLNode<Key, Value> *currParent = curr->getParent();   
-    int8_t ndiff;
-
-    // same as remove but with ndiff
-    if (currParent != nullptr)
-    {
-        // If removed node is left child of its parent, diff = +1
-        if (currParent->getLeft() == curr)
-        {
-            ndiff = 1;
-        }
-        // If removed node is right child of its parent, diff = -1
-        else
-        {
-            ndiff = -1;
-        }
-    }
-
-    /*
-        Case 1: balance(node) + diff == -/+ 2
-            Check if zig-zig or zig-zag (choose rotations using “taller” of children) depending on balance of node’s child
-            Perform rotation(s)
-            Update balance of node, child, grandchild
-            Call removeFix(parent, ndiff) accordingly
-    */
-   // similar to insert on LEFT SIDE
-    if (curr -> getBalance() + diff == -2)
-    {
-        // finish this
-        AVLNode<Key, Value>* currChild = curr -> getLeft();
-        if (currChild->getBalance() == 0)
-        {
-            // zig - zig
-            rotateRight(curr);
-            currChild->setBalance(1);
-            curr->setBalance(-1);
-            return;
-        }
-        else if (currChild -> getBalance() == -1)
-        {
-            // zig-zig
-            rotateRight(curr);
-            currChild -> setBalance(0);
-            curr -> setBalance (0);
-            removeFix(currParent, ndiff);
-        }
-        else if (currChild -> getBalance() == 1)
-        {
-            // zig - zag
-            AVLNode<Key, Value> *currGrand = currChild->getRight();
-            rotateLeft(currChild);
-            rotateRight(curr);
-
-            if (currGrand -> getBalance() == 0)
-            {
-                curr -> setBalance(0);
-                currChild->setBalance(0);
-            }
-            else if (currGrand -> getBalance() == -1)
-            {
-                curr -> setBalance(1);
-                currChild->setBalance(0);
-            }
-            else if(currGrand -> getBalance() == 1)
-            {
-                curr -> setBalance(0);
-                currChild->setBalance(-1);
-            }
-            currGrand -> setBalance(0);
-
-            removeFix(currParent, ndiff);
-        }
-    }
-    else if (curr-> getBalance() + diff == 2)
-    {
-        AVLNode<Key, Value> *currChild = curr->getRight();
-        if (currChild->getBalance() == 0)
-        {
-            // zig - zig
-            rotateLeft(curr);
-            currChild->setBalance(-1);
-            curr->setBalance(1);
-            return;
-        }
-        else if (currChild->getBalance() == 1) // adjust the test
-        {
-            // zig-zig
-            rotateLeft(curr);
-            currChild->setBalance(0);
-            curr->setBalance(0);
-            removeFix(currParent, ndiff);
-        }
-        else if (currChild->getBalance() == -1)
-        {
-            // zig - zag
-            AVLNode<Key, Value> *currGrand = currChild->getLeft();
-            rotateRight(currChild);
-            rotateLeft(curr);
-
-            if (currGrand->getBalance() == 0)
-            {
-                curr->setBalance(0);
-                currChild->setBalance(0);
-            }
-            else if (currGrand->getBalance() == -1)
-            {
-                curr->setBalance(0);
-                currChild->setBalance(1);
-            }
-            else if (currGrand->getBalance() == 1)
-            {
-                curr->setBalance(-1);
-                currChild->setBalance(0);
-            }
-            currGrand->setBalance(0);
-
-            removeFix(currParent, ndiff);
-        }
-    }
-    /*
-        Case 2: balance(node) + diff == -/+ 1
-            Update balance of node to -/+ 1
-            DONE!
-    */
-    else if (curr -> getBalance() + diff == -1)
-    {
-        curr -> setBalance(-1);
-        return;
-    }
-    else if(curr -> getBalance() + diff == 1)
-    {
-        curr ->setBalance(1);
-        return;
-    }
-    /*
-        Case 3: balance(node) + diff == 0
-            Update balance of node to 0
-            Call removeFix(parent, ndiff)
-    */
-    else if(curr -> getBalance() + diff == 0)
-    {
-        curr -> setBalance(0);
-        removeFix(currParent, ndiff);
-    }
-}
-
-template <class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key &key)
-{
-    // TODO
-    if (this->root_ == nullptr)
-    {
-        return;
-    }
-    // check if item is found
-    AVLNode<Key, Value> *currNode = internalFind(key);
-    if (currNode == nullptr)
-    {
-        return;
-    }
+    // remove(key) and erase(it) have already found the node
+    AVLNode<Key, Value> *currNode = static_cast<AVLNode<Key, Value> *>(node);
 
     /// check if item has 2 children -- get predecessor --> moce it to bottom
     if (currNode->getRight() != nullptr && currNode->getLeft() != nullptr)
@@ -630,6 +326,7 @@ void AVLTree<Key, Value>::remove(const Key &key)
         AVLNode<Key, Value> *predNode = predecessor(currNode);
         nodeSwap(currNode, predNode);
     }
+    this->nodeUnlinking(currNode);
     // keep track of the parent value and its balance factor is tracked
     AVLNode<Key, Value> *currParent = currNode->getParent();
     int8_t diff = 0;
@@ -708,9 +405,30 @@ void AVLTree<Key, Value>::remove(const Key &key)
         }
         currNode->getRight()->setParent(currParent);
     }
-    // remove node and call recursive to fix
-    delete currNode;
-    removeFix(currParent, diff);
+    // node is out -- fix the balances on the way up
+    this->size_--;
+    Ops ops(this);
+    Algo::removeFix(ops, currParent, diff == 1);
+}
+
+/*
+ * AVL trees already keep their height within 1.44 log n, and a DSW
+ * rebuild would leave every stored balance stale, so there is nothing
+ * to do here.
+ */
+template <class Key, class Value>
+void AVLTree<Key, Value>::rebalance()
+{
+}
+
+/*
+ * buildSorted() hands over the exact subtree heights, so the balance
+ * needs no further work.
+ */
+template <class Key, class Value>
+void AVLTree<Key, Value>::builtNode(Node<Key, Value> *node, int leftHeight, int rightHeight)
+{
+    static_cast<AVLNode<Key, Value> *>(node)->setBalance((int8_t)(rightHeight - leftHeight));
 }
 
 template <class Key, class Value>
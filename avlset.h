@@ -0,0 +1,332 @@
+#ifndef AVLSET_H
+#define AVLSET_H
+
+#include <cstdint>
+#include <cstddef>
+#include "avl_algorithms.h"
+
+/**
+ * A node for AVLSet. It holds only the key -- no Value, no std::pair and
+ * no vtable -- and puts the pointers first so the key and balance share
+ * the tail padding. For an int key that is 32 bytes against the 48 of an
+ * AVLNode<int, char>.
+ */
+template <typename Key>
+class AVLSetNode
+{
+public:
+    AVLSetNode(const Key &key, AVLSetNode<Key> *parent);
+
+    const Key &getKey() const;
+
+protected:
+    // AVLSet links nodes directly through AVLAlgorithms
+    template <typename K>
+    friend class AVLSet;
+
+    AVLSetNode<Key> *parent_;
+    AVLSetNode<Key> *left_;
+    AVLSetNode<Key> *right_;
+    const Key key_;
+    int8_t balance_;
+};
+
+template <typename Key>
+AVLSetNode<Key>::AVLSetNode(const Key &key, AVLSetNode<Key> *parent) : parent_(parent),
+                                                                       left_(nullptr),
+                                                                       right_(nullptr),
+                                                                       key_(key),
+                                                                       balance_(0)
+{
+}
+
+template <typename Key>
+const Key &AVLSetNode<Key>::getKey() const
+{
+    return key_;
+}
+
+/**
+ * An AVL tree of keys only, for when AVLTree<Key, char> would only be used
+ * as a set. insert(), remove(), find() and iteration behave like AVLTree's;
+ * the iterator yields const Key& instead of a pair.
+ */
+template <typename Key>
+class AVLSet
+{
+public:
+    AVLSet();
+    ~AVLSet();
+
+    void insert(const Key &key);
+    void remove(const Key &key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const Key &operator*() const;
+        const Key *operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+
+    protected:
+        friend class AVLSet<Key>;
+        iterator(AVLSetNode<Key> *ptr);
+        AVLSetNode<Key> *current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+
+protected:
+    typedef AVLSetNode<Key> SetNode;
+
+    // link access for AVLAlgorithms
+    struct Ops
+    {
+        typedef SetNode *Handle;
+        SetNode **root_;
+
+        // read-only walks (successor, leftmost) never touch the root
+        explicit Ops(SetNode **root = nullptr) : root_(root) {}
+
+        Handle nil() const { return nullptr; }
+        Handle parent(Handle n) const { return n->parent_; }
+        Handle left(Handle n) const { return n->left_; }
+        Handle right(Handle n) const { return n->right_; }
+        int balance(Handle n) const { return n->balance_; }
+        void setParent(Handle n, Handle p) { n->parent_ = p; }
+        void setLeft(Handle n, Handle l) { n->left_ = l; }
+        void setRight(Handle n, Handle r) { n->right_ = r; }
+        void setBalance(Handle n, int b) { n->balance_ = (int8_t)b; }
+        Handle root() const { return *root_; }
+        void setRoot(Handle r) { *root_ = r; }
+        void rotated(Handle) {}
+        void fixStep() {}
+    };
+    typedef AVLAlgorithms<Ops> Algo;
+
+    SetNode *internalFind(const Key &key) const;
+
+    SetNode *root_;
+    size_t size_;
+
+private:
+    // owns raw nodes
+    AVLSet(const AVLSet &);
+    AVLSet &operator=(const AVLSet &);
+};
+
+/*
+-----------------------------------------------------
+Begin implementations for the AVLSet::iterator class.
+-----------------------------------------------------
+*/
+
+template <typename Key>
+AVLSet<Key>::iterator::iterator() : current_(nullptr)
+{
+}
+
+template <typename Key>
+AVLSet<Key>::iterator::iterator(AVLSetNode<Key> *ptr) : current_(ptr)
+{
+}
+
+template <typename Key>
+const Key &AVLSet<Key>::iterator::operator*() const
+{
+    return current_->key_;
+}
+
+template <typename Key>
+const Key *AVLSet<Key>::iterator::operator->() const
+{
+    return &(current_->key_);
+}
+
+template <typename Key>
+bool AVLSet<Key>::iterator::operator==(const iterator &rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template <typename Key>
+bool AVLSet<Key>::iterator::operator!=(const iterator &rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template <typename Key>
+typename AVLSet<Key>::iterator &AVLSet<Key>::iterator::operator++()
+{
+    current_ = Algo::successor(Ops(), current_);
+    return *this;
+}
+
+/*
+-------------------------------------------
+Begin implementations for the AVLSet class.
+-------------------------------------------
+*/
+
+template <typename Key>
+AVLSet<Key>::AVLSet() : root_(nullptr), size_(0)
+{
+}
+
+template <typename Key>
+AVLSet<Key>::~AVLSet()
+{
+    clear();
+}
+
+template <typename Key>
+bool AVLSet<Key>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template <typename Key>
+size_t AVLSet<Key>::size() const
+{
+    return size_;
+}
+
+/**
+ * Adds the key if it is not already present.
+ */
+template <typename Key>
+void AVLSet<Key>::insert(const Key &key)
+{
+    SetNode *parent = nullptr;
+    SetNode *curr = root_;
+    bool asLeft = false;
+    while (curr != nullptr)
+    {
+        parent = curr;
+        if (key < curr->key_)
+        {
+            asLeft = true;
+            curr = curr->left_;
+        }
+        else if (curr->key_ < key)
+        {
+            asLeft = false;
+            curr = curr->right_;
+        }
+        else
+        {
+            // already there
+            return;
+        }
+    }
+    Ops o(&root_);
+    Algo::insertAt(o, parent, asLeft, new SetNode(key, parent));
+    size_++;
+}
+
+template <typename Key>
+void AVLSet<Key>::remove(const Key &key)
+{
+    SetNode *node = internalFind(key);
+    if (node == nullptr)
+    {
+        return;
+    }
+    Ops o(&root_);
+    Algo::erase(o, node);
+    delete node;
+    size_--;
+}
+
+/**
+ * Frees every node in O(n) with no recursion: go down to a leaf, free it,
+ * and continue from its parent.
+ */
+template <typename Key>
+void AVLSet<Key>::clear()
+{
+    SetNode *curr = root_;
+    while (curr != nullptr)
+    {
+        if (curr->left_ != nullptr)
+        {
+            curr = curr->left_;
+        }
+        else if (curr->right_ != nullptr)
+        {
+            curr = curr->right_;
+        }
+        else
+        {
+            SetNode *parent = curr->parent_;
+            if (parent != nullptr)
+            {
+                if (parent->left_ == curr)
+                {
+                    parent->left_ = nullptr;
+                }
+                else
+                {
+                    parent->right_ = nullptr;
+                }
+            }
+            delete curr;
+            curr = parent;
+        }
+    }
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template <typename Key>
+typename AVLSet<Key>::SetNode *AVLSet<Key>::internalFind(const Key &key) const
+{
+    SetNode *curr = root_;
+    while (curr != nullptr)
+    {
+        if (key < curr->key_)
+        {
+            curr = curr->left_;
+        }
+        else if (curr->key_ < key)
+        {
+            curr = curr->right_;
+        }
+        else
+        {
+            return curr;
+        }
+    }
+    return nullptr;
+}
+
+template <typename Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::begin() const
+{
+    return iterator(Algo::leftmost(Ops(), root_));
+}
+
+template <typename Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::end() const
+{
+    return iterator(nullptr);
+}
+
+template <typename Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::find(const Key &key) const
+{
+    return iterator(internalFind(key));
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "avlbst.h"
+#include "mapped_avl.h"
+#include "external_build.h"
+
+using namespace std;
+
+/**
+ * Building from an unsorted file of uint64_t key/value records: one
+ * insert() per record into an AVLTree, against ExternalSorter under a
+ * fixed memory budget feeding a balanced AVLTree build or a tree image.
+ * Each runs in its own child process so its peak RSS is its own. The
+ * image build holds no tree, so its peak stays near the budget however
+ * large the input is.
+ *
+ * Usage: ./bench-external [numRecords] [memoryMB] [dir]
+ */
+
+typedef std::chrono::steady_clock Clock;
+typedef ExternalSorter<uint64_t, uint64_t> Sorter;
+
+static double peakMegabytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is in kilobytes on Linux
+    return usage.ru_maxrss / 1024.0;
+}
+
+static void runBench(const char* name, int mode, const string& input, size_t numRecords, size_t memoryBytes, const string& dir)
+{
+    cout.flush();
+    pid_t child = fork();
+    if(child != 0) {
+        int status;
+        waitpid(child, &status, 0);
+        return;
+    }
+
+    Clock::time_point start = Clock::now();
+    size_t runs = 0;
+    size_t items;
+    if(mode == 0) {
+        AVLTree<uint64_t, uint64_t> tree;
+        SnapshotReader in(input);
+        std::pair<uint64_t, uint64_t> record;
+        while(!in.atEnd()) {
+            in.read(&record, sizeof(record));
+            tree.insert(record);
+        }
+        items = tree.size();
+    }
+    else {
+        Sorter sorter(memoryBytes, dir);
+        sorter.addFile(input);
+        runs = sorter.runs();
+        if(mode == 1) {
+            AVLTree<uint64_t, uint64_t> tree;
+            sorter.build(tree);
+            items = tree.size();
+        }
+        else {
+            string imagePath = dir + "/bench-external.image";
+            sorter.writeImage(imagePath);
+            items = MappedAVLTree<uint64_t, uint64_t>(imagePath).size();
+            std::remove(imagePath.c_str());
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double megabytes = numRecords * 16 / 1e6;
+    cout << name << ": " << seconds << " s, " << numRecords / seconds << " records/s ("
+         << megabytes / seconds << " MB/s), " << items << " items";
+    if(mode != 0) {
+        cout << ", " << runs << " runs";
+    }
+    cout << ", peak RSS " << peakMegabytes() << " MB" << endl;
+    _exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t numRecords = 4000000;
+    size_t memoryMB = 16;
+    string dir = ".";
+    if(argc > 1) {
+        numRecords = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        memoryMB = strtoul(argv[2], NULL, 10);
+    }
+    if(argc > 3) {
+        dir = argv[3];
+    }
+
+    // about one key in four repeats, so the merge has duplicates to drop
+    string input = dir + "/bench-external.in";
+    {
+        std::mt19937_64 rng(104);
+        SnapshotWriter out(input);
+        for(size_t i = 0; i < numRecords; i++) {
+            uint64_t record[2] = {rng() % (numRecords * 2), i};
+            out.write(record, sizeof(record));
+        }
+        out.close();
+    }
+
+    cout << numRecords << " records (" << numRecords * 16 / 1e6 << " MB), budget "
+         << memoryMB << " MB" << endl;
+    size_t memoryBytes = memoryMB << 20;
+    runBench("insert one by one", 0, input, numRecords, memoryBytes, dir);
+    runBench("external sort into AVLTree", 1, input, numRecords, memoryBytes, dir);
+    runBench("external sort into image", 2, input, numRecords, memoryBytes, dir);
+
+    std::remove(input.c_str());
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+/**
+ * Throughput of find_many() against a loop of single find() calls.
+ *
+ * Usage: ./bench-find-many [treeSize] [numQueries]
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsPer(Clock::time_point start, Clock::time_point stop, size_t ops)
+{
+    return std::chrono::duration<double, std::nano>(stop - start).count() / (double)ops;
+}
+
+template <typename Tree>
+static void runBench(const char* name, Tree& tree, const vector<int>& queries)
+{
+    typedef typename Tree::iterator Iter;
+
+    // single lookups
+    size_t hits = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < queries.size(); i++) {
+        if(tree.find(queries[i]) != tree.end()) {
+            hits++;
+        }
+    }
+    Clock::time_point stop = Clock::now();
+    double single = nsPer(start, stop, queries.size());
+
+    // batched lookups
+    vector<Iter> out;
+    size_t batchHits = 0;
+    start = Clock::now();
+    tree.find_many(queries, out);
+    for(size_t i = 0; i < out.size(); i++) {
+        if(out[i] != tree.end()) {
+            batchHits++;
+        }
+    }
+    stop = Clock::now();
+    double batched = nsPer(start, stop, queries.size());
+
+    if(hits != batchHits) {
+        cout << name << ": MISMATCH " << hits << " vs " << batchHits << endl;
+        exit(1);
+    }
+    cout << name << ": find " << single << " ns/op, find_many "
+         << batched << " ns/op, speedup " << single / batched << "x" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t treeSize = 1000000;
+    size_t numQueries = 1000000;
+    if(argc > 1) {
+        treeSize = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        numQueries = strtoul(argv[2], NULL, 10);
+    }
+
+    std::mt19937 rng(104);
+    vector<int> keys(treeSize);
+    for(size_t i = 0; i < treeSize; i++) {
+        keys[i] = (int)(i * 2);
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    // half of the queries hit, half miss (odd keys are never inserted)
+    vector<int> queries(numQueries);
+    std::uniform_int_distribution<int> pick(0, (int)(treeSize * 2 - 1));
+    for(size_t i = 0; i < numQueries; i++) {
+        queries[i] = pick(rng);
+    }
+
+    cout << treeSize << " keys, " << numQueries << " queries, "
+         << BST_FIND_MANY_LANES << " lanes" << endl;
+
+    BinarySearchTree<int, int> bst;
+    AVLTree<int, int> avl;
+    for(size_t i = 0; i < treeSize; i++) {
+        bst.insert(std::make_pair(keys[i], keys[i]));
+        avl.insert(std::make_pair(keys[i], keys[i]));
+    }
+    runBench("BinarySearchTree", bst, queries);
+    runBench("AVLTree", avl, queries);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "avlbst.h"
+#include "avlset.h"
+#include "compact_avl.h"
+#include "parentless_avl.h"
+
+using namespace std;
+
+/**
+ * Memory footprint of the alternative node layouts: AVLSet<uint32_t>
+ * against AVLTree<uint32_t, char> used as a set, and
+ * CompactAVLTree<uint32_t, uint32_t> and ParentlessAVLTree<uint32_t, uint32_t>
+ * against AVLTree<uint32_t, uint32_t>.
+ * Each tree is built in its own child process so the RSS numbers do not
+ * include the other trees or freed-but-cached heap.
+ *
+ * Usage: ./bench-memory [numKeys]   (default 10^8)
+ */
+
+// resident set size in bytes (Linux)
+static size_t residentBytes()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(f == NULL) {
+        return 0;
+    }
+    if(fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// i -> key is a bijection on uint32_t, so keys are distinct but unordered
+static uint32_t scramble(size_t i)
+{
+    return (uint32_t)(i * 2654435761u);
+}
+
+template <typename Tree>
+static void insertKey(Tree& tree, uint32_t key);
+
+template <>
+void insertKey(AVLTree<uint32_t, char>& tree, uint32_t key)
+{
+    tree.insert(std::make_pair(key, 'x'));
+}
+
+template <>
+void insertKey(AVLSet<uint32_t>& tree, uint32_t key)
+{
+    tree.insert(key);
+}
+
+template <>
+void insertKey(AVLTree<uint32_t, uint32_t>& tree, uint32_t key)
+{
+    tree.insert(std::make_pair(key, key));
+}
+
+template <>
+void insertKey(CompactAVLTree<uint32_t, uint32_t>& tree, uint32_t key)
+{
+    tree.insert(std::make_pair(key, key));
+}
+
+template <>
+void insertKey(ParentlessAVLTree<uint32_t, uint32_t>& tree, uint32_t key)
+{
+    tree.insert(std::make_pair(key, key));
+}
+
+template <typename Tree>
+static void measure(const char* name, size_t nodeBytes, size_t numKeys)
+{
+    pid_t pid = fork();
+    if(pid == 0) {
+        size_t before = residentBytes();
+        Tree* tree = new Tree;
+        for(size_t i = 0; i < numKeys; i++) {
+            insertKey(*tree, scramble(i));
+        }
+        size_t after = residentBytes();
+        cout << name << ": sizeof(node) = " << nodeBytes << " B, "
+             << (after - before) / (1024.0 * 1024.0) << " MiB resident, "
+             << (double)(after - before) / (double)numKeys << " B/key" << endl;
+        // skip the teardown, the process is about to exit anyway
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t numKeys = 100000000;
+    if(argc > 1) {
+        numKeys = strtoul(argv[1], NULL, 10);
+    }
+    cout << numKeys << " uint32_t keys" << endl;
+    measure<AVLTree<uint32_t, char> >("AVLTree<uint32_t, char>", sizeof(AVLNode<uint32_t, char>), numKeys);
+    measure<AVLSet<uint32_t> >("AVLSet<uint32_t>", sizeof(AVLSetNode<uint32_t>), numKeys);
+    measure<AVLTree<uint32_t, uint32_t> >("AVLTree<uint32_t, uint32_t>", sizeof(AVLNode<uint32_t, uint32_t>), numKeys);
+    measure<CompactAVLTree<uint32_t, uint32_t> >("CompactAVLTree<uint32_t, uint32_t>", sizeof(CompactAVLNode<uint32_t, uint32_t>), numKeys);
+    measure<ParentlessAVLTree<uint32_t, uint32_t> >("ParentlessAVLTree<uint32_t, uint32_t>", sizeof(ParentlessAVLNode<uint32_t, uint32_t>), numKeys);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include "avlbst.h"
+#include "parallel_build.h"
+
+using namespace std;
+
+/**
+ * Building an AVLTree<uint64_t, uint64_t> from an unsorted vector: one
+ * insert() per item on one thread, against ParallelBuilder::build() (sort,
+ * then balanced build) with 1, 2, 4, ... threads up to maxThreads, each
+ * with its speedup over the one-thread build. Every run starts from the
+ * same unsorted copy.
+ *
+ * Usage: ./bench-parallel-build [numItems] [maxThreads]
+ *        (maxThreads defaults to the core count)
+ */
+
+typedef std::chrono::steady_clock Clock;
+typedef std::pair<uint64_t, uint64_t> Item;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    size_t numItems = 4000000;
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    if(argc > 1) {
+        numItems = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        maxThreads = (unsigned)strtoul(argv[2], NULL, 10);
+    }
+    if(maxThreads == 0) {
+        maxThreads = 1;
+    }
+
+    std::mt19937_64 rng(104);
+    vector<Item> items(numItems);
+    for(size_t i = 0; i < numItems; i++) {
+        items[i] = Item(rng(), i);
+    }
+
+    cout << numItems << " items, " << std::thread::hardware_concurrency() << " cores" << endl;
+
+    Clock::time_point start = Clock::now();
+    size_t inserted;
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for(size_t i = 0; i < numItems; i++) {
+            tree.insert(items[i]);
+        }
+        inserted = tree.size();
+    }
+    cout << "insert one by one: " << secondsSince(start) << " s" << endl;
+
+    double oneThread = 0;
+    for(unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        vector<Item> copy(items);
+        AVLTree<uint64_t, uint64_t> tree;
+        ParallelBuilder<uint64_t, uint64_t> builder(threads);
+        start = Clock::now();
+        builder.build(tree, copy);
+        double seconds = secondsSince(start);
+        if(threads == 1) {
+            oneThread = seconds;
+        }
+        cout << "parallel build, " << threads << " threads: " << seconds << " s, speedup "
+             << oneThread / seconds << endl;
+        if(tree.size() != inserted) {
+            cout << "size mismatch" << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
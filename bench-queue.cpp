@@ -0,0 +1,78 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+/**
+ * AVLTree used as a work queue in steady state: take the smallest item
+ * and schedule a new one a random distance later. Compares
+ * remove(begin()->first) against pop_min().
+ *
+ * Usage: ./bench-queue [queueSize] [numOps]
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static void fill(AVLTree<long, int>& queue, size_t queueSize)
+{
+    for(size_t i = 0; i < queueSize; i++) {
+        queue.insert(std::make_pair((long)i * 1000, (int)i));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t queueSize = 100000;
+    size_t numOps = 2000000;
+    if(argc > 1) {
+        queueSize = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        numOps = strtoul(argv[2], NULL, 10);
+    }
+
+    std::mt19937 rng(104);
+    vector<long> delays(numOps);
+    std::uniform_int_distribution<long> pick(1, (long)queueSize * 1000);
+    for(size_t i = 0; i < numOps; i++) {
+        delays[i] = pick(rng);
+    }
+
+    cout << queueSize << " queued items, " << numOps << " pop+push pairs" << endl;
+
+    // multimap mode, so equal deadlines do not collapse
+    AVLTree<long, int> byKey(true);
+    fill(byKey, queueSize);
+    long sum = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < numOps; i++) {
+        long now = byKey.begin()->first;
+        byKey.remove(now);
+        sum += now;
+        byKey.insert(std::make_pair(now + delays[i], (int)i));
+    }
+    Clock::time_point stop = Clock::now();
+    cout << "remove(begin()->first): "
+         << std::chrono::duration<double, std::nano>(stop - start).count() / (double)numOps
+         << " ns/op (checksum " << sum << ")" << endl;
+
+    AVLTree<long, int> popped(true);
+    fill(popped, queueSize);
+    sum = 0;
+    start = Clock::now();
+    for(size_t i = 0; i < numOps; i++) {
+        long now = popped.extract_min().first;
+        sum += now;
+        popped.insert(std::make_pair(now + delays[i], (int)i));
+    }
+    stop = Clock::now();
+    cout << "extract_min():          "
+         << std::chrono::duration<double, std::nano>(stop - start).count() / (double)numOps
+         << " ns/op (checksum " << sum << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+#include "parentless_avl.h"
+
+using namespace std;
+
+/**
+ * Full in-order scan cost of a plain AVLTree (successor() over parent
+ * pointers), a threaded AVLTree (next links) and a ParentlessAVLTree
+ * (iterator stack). Keys are inserted in random order so neighbouring
+ * nodes are spread over the heap.
+ *
+ * Usage: ./bench-scan [treeSize] [passes]
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+template <typename Tree>
+static void runBench(const char* name, const Tree& tree, size_t treeSize, size_t passes)
+{
+    long long sum = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t p = 0; p < passes; p++) {
+        for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            sum += it->second;
+        }
+    }
+    Clock::time_point stop = Clock::now();
+    double ns = std::chrono::duration<double, std::nano>(stop - start).count() / (double)(treeSize * passes);
+    cout << name << ": " << ns << " ns/element (checksum " << sum << ")" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t treeSize = 1000000;
+    size_t passes = 5;
+    if(argc > 1) {
+        treeSize = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        passes = strtoul(argv[2], NULL, 10);
+    }
+
+    std::mt19937 rng(104);
+    vector<int> keys(treeSize);
+    for(size_t i = 0; i < treeSize; i++) {
+        keys[i] = (int)i;
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    cout << treeSize << " keys, " << passes << " passes" << endl;
+
+    AVLTree<int, int> plain;
+    AVLTree<int, int> threaded(false, true);
+    ParentlessAVLTree<int, int> parentless;
+    for(size_t i = 0; i < treeSize; i++) {
+        plain.insert(std::make_pair(keys[i], keys[i]));
+        threaded.insert(std::make_pair(keys[i], keys[i]));
+        parentless.insert(std::make_pair(keys[i], keys[i]));
+    }
+    runBench("AVLTree", plain, treeSize, passes);
+    runBench("AVLTree (threaded)", threaded, treeSize, passes);
+    runBench("ParentlessAVLTree", parentless, treeSize, passes);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "mapped_avl.h"
+
+using namespace std;
+
+/**
+ * Restart cost of an AVLTree<uint64_t, uint64_t>: rebuilding it with one
+ * insert() per key (in file order, i.e. shuffled) against save() and a
+ * load() of the binary snapshot, and against opening a MappedAVLTree
+ * image, which copies nothing. The load rate is also given in MB/s so it
+ * can be compared with the disk. Random finds on the loaded tree and on
+ * the mapped image show what the mapping costs per lookup once warm.
+ *
+ * Usage: ./bench-snapshot [treeSize] [path]
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    size_t treeSize = 2000000;
+    string path = "bench-snapshot.bin";
+    if(argc > 1) {
+        treeSize = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        path = argv[2];
+    }
+
+    std::mt19937_64 rng(104);
+    vector<uint64_t> keys(treeSize);
+    for(size_t i = 0; i < treeSize; i++) {
+        keys[i] = i * 7;
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    cout << treeSize << " keys" << endl;
+
+    Clock::time_point start = Clock::now();
+    AVLTree<uint64_t, uint64_t> built;
+    for(size_t i = 0; i < treeSize; i++) {
+        built.insert(std::make_pair(keys[i], keys[i] + 1));
+    }
+    cout << "insert one by one: " << secondsSince(start) << " s" << endl;
+
+    start = Clock::now();
+    built.save(path);
+    double saveSeconds = secondsSince(start);
+    double megabytes = (double)(sizeof(SnapshotHeader) + treeSize * 16) / 1e6;
+    cout << "save: " << saveSeconds << " s (" << megabytes / saveSeconds << " MB/s)" << endl;
+
+    start = Clock::now();
+    AVLTree<uint64_t, uint64_t> loaded;
+    loaded.load(path);
+    double loadSeconds = secondsSince(start);
+    cout << "load: " << loadSeconds << " s (" << megabytes / loadSeconds << " MB/s)" << endl;
+
+    string imagePath = path + ".image";
+    start = Clock::now();
+    MappedAVLTree<uint64_t, uint64_t>::write(imagePath, loaded);
+    cout << "write image: " << secondsSince(start) << " s" << endl;
+
+    start = Clock::now();
+    MappedAVLTree<uint64_t, uint64_t> mapped(imagePath);
+    cout << "open image: " << secondsSince(start) * 1e6 << " us" << endl;
+
+    if(loaded.size() != built.size() || loaded.max().first != built.max().first ||
+       mapped.size() != built.size()) {
+        cout << "mismatch after load" << endl;
+        return 1;
+    }
+
+    uint64_t sum = 0;
+    start = Clock::now();
+    for(size_t i = 0; i < treeSize; i++) {
+        sum += loaded.find(keys[i])->second;
+    }
+    cout << "find on loaded tree: " << secondsSince(start) * 1e9 / treeSize << " ns/op" << endl;
+    start = Clock::now();
+    for(size_t i = 0; i < treeSize; i++) {
+        sum -= mapped.find(keys[i])->second;
+    }
+    cout << "find on mapped image: " << secondsSince(start) * 1e9 / treeSize << " ns/op"
+         << " (checksum " << sum << ")" << endl;
+
+    std::remove(path.c_str());
+    std::remove(imagePath.c_str());
+    return 0;
+}
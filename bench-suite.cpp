@@ -0,0 +1,326 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+/**
+ * Microbenchmark suite: insert, find, operator[], iteration and remove on
+ * BinarySearchTree, AVLTree and std::map, for int, uint64_t and
+ * std::string keys, at every power of ten from minSize to maxSize, with
+ * the keys in four orders:
+ *   sequential   ascending keys throughout
+ *   random       inserts and removes shuffled, lookups uniform
+ *   zipf         inserts and removes shuffled, lookups Zipf (s = 1), the
+ *                hot keys spread over the key range
+ *   adversarial  inserts, lookups and removes alternate smallest and
+ *                largest remaining key (a degenerate chain for the
+ *                unbalanced tree, constant rotations for AVL)
+ * The unbalanced tree is skipped above 10^4 for the two orders that make
+ * it a list, where each insert is O(n).
+ *
+ * Output is CSV on stdout, one row per structure, key type, order, size
+ * and operation, with lines starting '#' as comments:
+ *   structure,key,order,size,op,ops_per_sec,ns_per_op,p50_ns,p99_ns,p999_ns,max_ns
+ * Reading the clock per operation would cost about as much as a find, so
+ * the percentiles are over batches of BATCH consecutive operations, each
+ * divided by BATCH. Lookups make min(size, 10^6) queries.
+ *
+ * Usage: ./bench-suite [maxSize] [minSize]   (default 10^6 and 10^3;
+ *        10^8 needs several GB per tree)
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t BATCH = 16;
+static const size_t MAX_QUERIES = 1000000;
+
+enum Order
+{
+    SEQUENTIAL,
+    RANDOM,
+    ZIPF,
+    ADVERSARIAL
+};
+
+static const char* const ORDER_NAMES[] = {"sequential", "random", "zipf", "adversarial"};
+
+// rank -> key, preserving order, so every key type sees the same trees
+template <typename Key>
+struct KeyMaker;
+
+template <>
+struct KeyMaker<int>
+{
+    static const char* name() { return "int"; }
+    static int make(size_t rank) { return (int)rank; }
+};
+
+template <>
+struct KeyMaker<uint64_t>
+{
+    static const char* name() { return "uint64"; }
+    // spread out, so the keys are not just small integers
+    static uint64_t make(size_t rank) { return (uint64_t)rank * 1000003; }
+};
+
+template <>
+struct KeyMaker<std::string>
+{
+    static const char* name() { return "string"; }
+    // zero padded, so string order is numeric order
+    static std::string make(size_t rank)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "key%012llu", (unsigned long long)rank);
+        return buffer;
+    }
+};
+
+/**
+ * Per-batch timings of one operation, reduced to a CSV row.
+ */
+class OpTimer
+{
+public:
+    OpTimer() : ops_(0), total_(0) {}
+
+    void record(Clock::time_point start, size_t ops)
+    {
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        total_ += ns;
+        ops_ += ops;
+        batches_.push_back(ns / ops);
+    }
+
+    void report(const string& prefix, const char* op)
+    {
+        if(ops_ == 0) {
+            return;
+        }
+        std::sort(batches_.begin(), batches_.end());
+        cout << prefix << op << "," << ops_ / (total_ * 1e-9) << "," << total_ / ops_ << ","
+             << percentile(0.5) << "," << percentile(0.99) << "," << percentile(0.999) << ","
+             << batches_.back() << endl;
+    }
+
+protected:
+    double percentile(double p) const
+    {
+        size_t index = (size_t)(p * (batches_.size() - 1));
+        return batches_[index];
+    }
+
+    size_t ops_;
+    double total_;
+    vector<double> batches_;
+};
+
+// the three structures differ only in how a key is removed
+template <typename Key>
+void removeKey(std::map<Key, int>& tree, const Key& key)
+{
+    tree.erase(key);
+}
+
+template <typename Tree, typename Key>
+void removeKey(Tree& tree, const Key& key)
+{
+    tree.remove(key);
+}
+
+/**
+ * 0, n-1, 1, n-2, ...
+ */
+static void zigzag(size_t n, vector<size_t>& ranks)
+{
+    ranks.resize(n);
+    size_t lo = 0;
+    size_t hi = n;
+    for(size_t i = 0; i < n; i++) {
+        ranks[i] = (i % 2 == 0) ? lo++ : --hi;
+    }
+}
+
+/**
+ * Insert/remove ranks and lookup ranks for one order.
+ */
+static void makeOrder(Order order, size_t n, std::mt19937_64& rng, vector<size_t>& updates, vector<size_t>& queries)
+{
+    size_t numQueries = std::min(n, MAX_QUERIES);
+    queries.resize(numQueries);
+    if(order == SEQUENTIAL) {
+        updates.resize(n);
+        for(size_t i = 0; i < n; i++) {
+            updates[i] = i;
+        }
+        for(size_t i = 0; i < numQueries; i++) {
+            queries[i] = i * (n / numQueries);
+        }
+        return;
+    }
+    if(order == ADVERSARIAL) {
+        zigzag(n, updates);
+        vector<size_t> all;
+        zigzag(numQueries, all);
+        for(size_t i = 0; i < numQueries; i++) {
+            queries[i] = all[i] * (n / numQueries);
+        }
+        return;
+    }
+    updates.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        updates[i] = i;
+    }
+    std::shuffle(updates.begin(), updates.end(), rng);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for(size_t i = 0; i < numQueries; i++) {
+        if(order == RANDOM) {
+            queries[i] = rng() % n;
+        }
+        else {
+            // inverse of the continuous 1/x density on [1, n + 1)
+            size_t hot = (size_t)std::exp(unit(rng) * std::log((double)n + 1.0)) - 1;
+            hot = std::min(hot, n - 1);
+            // an odd multiplier coprime to 10^k permutes the ranks
+            queries[i] = (size_t)(((unsigned long long)hot * 2654435761ULL) % n);
+        }
+    }
+}
+
+template <typename Tree, typename Key>
+static void runOps(const string& prefix, const vector<Key>& updates, const vector<Key>& queries)
+{
+    Tree tree;
+    OpTimer insertTimer;
+    for(size_t i = 0; i < updates.size(); i += BATCH) {
+        size_t end = std::min(i + BATCH, updates.size());
+        Clock::time_point start = Clock::now();
+        for(size_t j = i; j < end; j++) {
+            tree.insert(std::make_pair(updates[j], (int)j));
+        }
+        insertTimer.record(start, end - i);
+    }
+    insertTimer.report(prefix, "insert");
+
+    OpTimer findTimer;
+    size_t hits = 0;
+    for(size_t i = 0; i < queries.size(); i += BATCH) {
+        size_t end = std::min(i + BATCH, queries.size());
+        Clock::time_point start = Clock::now();
+        for(size_t j = i; j < end; j++) {
+            hits += (tree.find(queries[j]) != tree.end());
+        }
+        findTimer.record(start, end - i);
+    }
+    findTimer.report(prefix, "find");
+
+    OpTimer indexTimer;
+    long long sum = 0;
+    for(size_t i = 0; i < queries.size(); i += BATCH) {
+        size_t end = std::min(i + BATCH, queries.size());
+        Clock::time_point start = Clock::now();
+        for(size_t j = i; j < end; j++) {
+            sum += tree[queries[j]];
+        }
+        indexTimer.record(start, end - i);
+    }
+    indexTimer.report(prefix, "operator[]");
+
+    OpTimer iterateTimer;
+    typename Tree::iterator it = tree.begin();
+    while(it != tree.end()) {
+        size_t steps = 0;
+        Clock::time_point start = Clock::now();
+        for(; steps < BATCH && it != tree.end(); ++it, ++steps) {
+            sum += it->second;
+        }
+        iterateTimer.record(start, steps);
+    }
+    iterateTimer.report(prefix, "iterate");
+
+    OpTimer removeTimer;
+    for(size_t i = 0; i < updates.size(); i += BATCH) {
+        size_t end = std::min(i + BATCH, updates.size());
+        Clock::time_point start = Clock::now();
+        for(size_t j = i; j < end; j++) {
+            removeKey(tree, updates[j]);
+        }
+        removeTimer.record(start, end - i);
+    }
+    removeTimer.report(prefix, "remove");
+
+    if(hits != queries.size() || !tree.empty()) {
+        cout << "# " << prefix << "FAILED: " << hits << " of " << queries.size() << " found" << endl;
+        exit(1);
+    }
+    // keep the lookups from being optimised away
+    if(sum == 42) {
+        cout << "#" << endl;
+    }
+}
+
+template <typename Key>
+static void runKeyType(size_t minSize, size_t maxSize)
+{
+    for(size_t n = minSize; n <= maxSize; n *= 10) {
+        for(int order = SEQUENTIAL; order <= ADVERSARIAL; order++) {
+            std::mt19937_64 rng(104 + n + order);
+            vector<size_t> updateRanks;
+            vector<size_t> queryRanks;
+            makeOrder((Order)order, n, rng, updateRanks, queryRanks);
+            vector<Key> updates(n);
+            vector<Key> queries(queryRanks.size());
+            for(size_t i = 0; i < n; i++) {
+                updates[i] = KeyMaker<Key>::make(updateRanks[i]);
+            }
+            for(size_t i = 0; i < queries.size(); i++) {
+                queries[i] = KeyMaker<Key>::make(queryRanks[i]);
+            }
+
+            char suffix[64];
+            snprintf(suffix, sizeof(suffix), ",%s,%s,%llu,", KeyMaker<Key>::name(), ORDER_NAMES[order],
+                     (unsigned long long)n);
+            bool degenerate = (order == SEQUENTIAL || order == ADVERSARIAL);
+            if(degenerate && n > 10000) {
+                cout << "# skipped BinarySearchTree" << suffix << " O(n) per insert" << endl;
+            }
+            else {
+                runOps<BinarySearchTree<Key, int> >(string("BinarySearchTree") + suffix, updates, queries);
+            }
+            runOps<AVLTree<Key, int> >(string("AVLTree") + suffix, updates, queries);
+            runOps<std::map<Key, int> >(string("std::map") + suffix, updates, queries);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t maxSize = 1000000;
+    size_t minSize = 1000;
+    if(argc > 1) {
+        maxSize = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        minSize = strtoul(argv[2], NULL, 10);
+    }
+    if(minSize == 0) {
+        minSize = 1;
+    }
+
+    cout << "structure,key,order,size,op,ops_per_sec,ns_per_op,p50_ns,p99_ns,p999_ns,max_ns" << endl;
+    runKeyType<int>(minSize, maxSize);
+    runKeyType<uint64_t>(minSize, maxSize);
+    runKeyType<std::string>(minSize, maxSize);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include "avlbst.h"
+#include "parallel_traversal.h"
+
+using namespace std;
+
+/**
+ * Full-tree passes over an AVLTree<uint64_t, uint64_t>: summing the
+ * values and exporting the keys in order, with an iterator loop on one
+ * thread against parallel_reduce() and to_vector() on 1, 2, 4, ...
+ * threads up to maxThreads, and parallel_for_each() updating every value.
+ *
+ * Usage: ./bench-traversal [treeSize] [maxThreads]
+ *        (maxThreads defaults to the core count)
+ */
+
+typedef std::chrono::steady_clock Clock;
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+struct ValueOf
+{
+    uint64_t operator()(const std::pair<const uint64_t, uint64_t>& item) const
+    {
+        return item.second;
+    }
+};
+
+struct KeyOf
+{
+    uint64_t operator()(const std::pair<const uint64_t, uint64_t>& item) const
+    {
+        return item.first;
+    }
+};
+
+struct Add
+{
+    uint64_t operator()(uint64_t a, uint64_t b) const
+    {
+        return a + b;
+    }
+};
+
+struct Bump
+{
+    void operator()(std::pair<const uint64_t, uint64_t>& item) const
+    {
+        item.second++;
+    }
+};
+
+static double msSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count() * 1e3;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t treeSize = 4000000;
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    if(argc > 1) {
+        treeSize = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        maxThreads = (unsigned)strtoul(argv[2], NULL, 10);
+    }
+    if(maxThreads == 0) {
+        maxThreads = 1;
+    }
+
+    std::mt19937_64 rng(104);
+    Tree tree;
+    for(size_t i = 0; i < treeSize; i++) {
+        tree.insert(std::make_pair(rng(), (uint64_t)i));
+    }
+    cout << tree.size() << " items, " << std::thread::hardware_concurrency() << " cores" << endl;
+
+    Clock::time_point start = Clock::now();
+    uint64_t expected = 0;
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        expected += it->second;
+    }
+    cout << "iterator sum: " << msSince(start) << " ms" << endl;
+
+    start = Clock::now();
+    vector<uint64_t> keys;
+    keys.reserve(tree.size());
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        keys.push_back(it->first);
+    }
+    cout << "iterator export: " << msSince(start) << " ms" << endl;
+
+    for(unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        start = Clock::now();
+        uint64_t sum = parallel_reduce(tree, (uint64_t)0, ValueOf(), Add(), threads);
+        double reduceMs = msSince(start);
+
+        start = Clock::now();
+        vector<uint64_t> exported;
+        to_vector(tree, exported, KeyOf(), threads);
+        double exportMs = msSince(start);
+
+        start = Clock::now();
+        parallel_for_each(tree, Bump(), threads);
+        double forEachMs = msSince(start);
+
+        cout << threads << " threads: parallel_reduce " << reduceMs << " ms, to_vector " << exportMs
+             << " ms, parallel_for_each " << forEachMs << " ms" << endl;
+        if(sum != expected || exported != keys) {
+            cout << "mismatch" << endl;
+            return 1;
+        }
+        expected += tree.size();
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "avlbst.h"
+#include "wal.h"
+
+using namespace std;
+
+/**
+ * Insert throughput of a DurableAVLTree<uint64_t, uint64_t> under each
+ * durability setting, against a plain AVLTree with no log. The fsync
+ * rows depend almost entirely on the device under dir. Then the cost of
+ * a full checkpoint against a delta checkpoint after 1% of the keys of a
+ * larger tree changed.
+ *
+ * Usage: ./bench-wal [numOps] [dir] [checkpointSize]
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static void runBench(const char* name, const vector<uint64_t>& keys, const string& dir, const WALOptions& options)
+{
+    string snapshotPath = dir + "/bench-wal.snap";
+    string logPath = dir + "/bench-wal.log";
+    std::remove(snapshotPath.c_str());
+    std::remove(logPath.c_str());
+
+    Clock::time_point start = Clock::now();
+    {
+        DurableAVLTree<uint64_t, uint64_t> tree(snapshotPath, logPath, options);
+        for(size_t i = 0; i < keys.size(); i++) {
+            tree.insert(std::make_pair(keys[i], (uint64_t)i));
+        }
+        tree.commit();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    cout << name << ": " << keys.size() / seconds << " inserts/s" << endl;
+
+    std::remove(snapshotPath.c_str());
+    std::remove(logPath.c_str());
+    std::remove((snapshotPath + ".lock").c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    size_t numOps = 20000;
+    string dir = ".";
+    if(argc > 1) {
+        numOps = strtoul(argv[1], NULL, 10);
+    }
+    if(argc > 2) {
+        dir = argv[2];
+    }
+    size_t checkpointSize = 1000000;
+    if(argc > 3) {
+        checkpointSize = strtoul(argv[3], NULL, 10);
+    }
+
+    std::mt19937_64 rng(104);
+    vector<uint64_t> keys(numOps);
+    for(size_t i = 0; i < numOps; i++) {
+        keys[i] = rng();
+    }
+
+    cout << numOps << " inserts" << endl;
+
+    Clock::time_point start = Clock::now();
+    AVLTree<uint64_t, uint64_t> plain;
+    for(size_t i = 0; i < numOps; i++) {
+        plain.insert(std::make_pair(keys[i], (uint64_t)i));
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    cout << "no log: " << numOps / seconds << " inserts/s" << endl;
+
+    runBench("log, no fsync, write per insert", keys, dir, WALOptions(1, 0));
+    runBench("log, no fsync, groups of 64", keys, dir, WALOptions(64, 0));
+    runBench("log, fsync per insert", keys, dir, WALOptions(1, 1));
+    runBench("log, fsync per group of 16", keys, dir, WALOptions(16, 1));
+    runBench("log, fsync per group of 256", keys, dir, WALOptions(256, 1));
+    runBench("log, groups of 64, fsync every 16 groups", keys, dir, WALOptions(64, 16));
+
+    string snapshotPath = dir + "/bench-wal.snap";
+    string logPath = dir + "/bench-wal.log";
+    {
+        DurableAVLTree<uint64_t, uint64_t> tree(snapshotPath, logPath, WALOptions(1024, 0));
+        for(size_t i = 0; i < checkpointSize; i++) {
+            tree.insert(std::make_pair((uint64_t)i, (uint64_t)i));
+        }
+        // sync the log first, so only checkpoint I/O is timed
+        tree.commit();
+        start = Clock::now();
+        tree.checkpoint();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        cout << checkpointSize << " keys, full checkpoint: " << seconds * 1e3 << " ms" << endl;
+
+        // the first round also pays for the heap reusing the dirty set
+        // the full checkpoint freed, so show two
+        for(int round = 0; round < 2; round++) {
+            for(size_t i = 0; i < checkpointSize / 100; i++) {
+                tree.insert(std::make_pair((uint64_t)(rng() % checkpointSize), (uint64_t)i));
+            }
+            size_t dirty = tree.dirtyCount();
+            tree.commit();
+            start = Clock::now();
+            tree.checkpointDelta();
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            cout << dirty << " changed keys, delta checkpoint: " << seconds * 1e3 << " ms" << endl;
+        }
+
+        start = Clock::now();
+        tree.compact();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        cout << "compact: " << seconds * 1e3 << " ms" << endl;
+    }
+    std::remove(snapshotPath.c_str());
+    std::remove(logPath.c_str());
+    std::remove((snapshotPath + ".lock").c_str());
+    return 0;
+}
@@ -0,0 +1,307 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "wal.h"
+#include "parallel_build.h"
+
+using namespace std;
+
+/**
+ * Stress test for the stack-safe tree routines. Builds degenerate chains
+ * millions of levels deep and runs every whole-tree routine on them; any
+ * leftover recursion would overflow the call stack long before the end.
+ * Also checks DurableAVLTree recovery and ParallelBuilder against
+ * std::map models.
+ *
+ * Usage: ./bst-stress [depth]   (default 10^7)
+ */
+
+// Links the chain directly so setup is O(n) rather than O(n^2) inserts
+template <typename Key, typename Value>
+class ChainTree : public BinarySearchTree<Key, Value>
+{
+public:
+    void buildChain(size_t n, bool rightLeaning)
+    {
+        this->clear();
+        Node<Key, Value>* tail = nullptr;
+        for(size_t i = 0; i < n; i++) {
+            Key key = rightLeaning ? (Key)i : (Key)(n - 1 - i);
+            Node<Key, Value>* node = new Node<Key, Value>(key, (Value)i, tail);
+            if(tail == nullptr) {
+                this->root_ = node;
+            }
+            else if(rightLeaning) {
+                tail->setRight(node);
+            }
+            else {
+                tail->setLeft(node);
+            }
+            tail = node;
+        }
+        this->size_ = n;
+        this->maxSize_ = n;
+        this->leftmost_ = rightLeaning ? this->root_ : tail;
+        this->rightmost_ = rightLeaning ? tail : this->root_;
+    }
+    int height() const
+    {
+        return this->getHeight(this->root_);
+    }
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* msg)
+{
+    cout << (ok ? "PASS: " : "FAIL: ") << msg << endl;
+    if(!ok) {
+        failures++;
+    }
+}
+
+static bool inOrder(const BinarySearchTree<long, long>& tree, size_t n)
+{
+    size_t count = 0;
+    long prev = -1;
+    for(BinarySearchTree<long, long>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        if(it->first <= prev) {
+            return false;
+        }
+        prev = it->first;
+        count++;
+    }
+    return count == n;
+}
+
+static void chainTest(size_t n, bool rightLeaning)
+{
+    cout << (rightLeaning ? "Right" : "Left") << " chain of depth " << n << endl;
+    ChainTree<long, long> tree;
+    tree.buildChain(n, rightLeaning);
+
+    check(tree.height() == (int)n - 1, "getHeight() on chain");
+    check(!tree.isBalanced(), "isBalanced() on chain");
+    check(inOrder(tree, n), "in-order iteration over chain");
+    check(tree.find((long)n - 1) != tree.end(), "find() deepest key");
+
+    tree.rebalance();
+    check(tree.isBalanced(), "isBalanced() after rebalance()");
+    check(tree.height() == (int)std::floor(std::log2((double)n)), "getHeight() after rebalance()");
+    check(inOrder(tree, n), "in-order iteration after rebalance()");
+
+    // tear the chain down again through clear() rather than the rebuilt tree
+    tree.buildChain(n, rightLeaning);
+    tree.clear();
+    check(tree.empty(), "clear() on chain");
+}
+
+static void avlTest(size_t n)
+{
+    cout << "AVL sorted insert/remove of " << n << " keys" << endl;
+    AVLTree<long, long> tree;
+    for(size_t i = 0; i < n; i++) {
+        tree.insert(std::make_pair((long)i, (long)i));
+    }
+    check(tree.isBalanced(), "isBalanced() after sorted inserts");
+    for(size_t i = 0; i < n; i += 2) {
+        tree.remove((long)i);
+    }
+    check(tree.isBalanced(), "isBalanced() after removing every other key");
+    check(tree.find(1) != tree.end() && tree.find(2) == tree.end(), "find() after removes");
+}
+
+static const char* WAL_SNAPSHOT = "bst-stress-wal.snap";
+static const char* WAL_LOG = "bst-stress-wal.log";
+typedef DurableAVLTree<long, long> DurableTree;
+
+static bool sameAs(const AVLTree<long, long>& tree, const std::map<long, long>& model)
+{
+    if(tree.size() != model.size()) {
+        return false;
+    }
+    std::map<long, long>::const_iterator expected = model.begin();
+    for(AVLTree<long, long>::const_iterator it = tree.begin(); it != tree.end(); ++it, ++expected) {
+        if(it->first != expected->first || it->second != expected->second) {
+            return false;
+        }
+    }
+    return tree.isBalanced();
+}
+
+static void removeWalFiles()
+{
+    std::remove(WAL_SNAPSHOT);
+    std::remove(WAL_LOG);
+    std::remove((std::string(WAL_SNAPSHOT) + ".lock").c_str());
+    for(uint32_t epoch = 1; epoch < 100; epoch++) {
+        std::remove((std::string(WAL_SNAPSHOT) + ".delta." + std::to_string(epoch)).c_str());
+    }
+}
+
+// One random insert (value i) or remove of a key in [0, keys), applied
+// to both; returns the key, with value -1 for a remove
+static std::pair<long, long> mutate(DurableTree& tree, std::map<long, long>& model, long i, long keys, std::mt19937& rng)
+{
+    long key = (long)(rng() % keys);
+    if(rng() % 3 == 0) {
+        tree.remove(key);
+        model.erase(key);
+        return std::make_pair(key, -1L);
+    }
+    tree.insert(std::make_pair(key, i));
+    model[key] = i;
+    return std::make_pair(key, i);
+}
+
+static off_t fileSize(const char* path)
+{
+    struct stat info;
+    return ::stat(path, &info) == 0 ? info.st_size : -1;
+}
+
+/**
+ * Reopens after each kind of checkpoint with more logged mutations on
+ * top, then cuts the log in the middle of a record and appends a frame
+ * claiming a 4 GB record: recovery must keep exactly the whole records.
+ */
+static void walTest(size_t n)
+{
+    cout << "Durable AVL recovery over " << n << " mutations per round" << endl;
+    removeWalFiles();
+    std::mt19937 rng(42);
+    std::map<long, long> model;
+    long keys = (long)n;
+    const char* kinds[] = {"checkpoint()", "checkpointDelta()", "compact()"};
+    for(int kind = 0; kind < 3; kind++) {
+        {
+            DurableTree tree(WAL_SNAPSHOT, WAL_LOG, WALOptions(64, 0));
+            for(size_t i = 0; i < n; i++) {
+                mutate(tree, model, (long)i, keys, rng);
+                // compact() needs deltas to fold: take several along the way
+                if(kind == 2 && i % (n / 4 + 1) == n / 4) {
+                    tree.checkpointDelta();
+                }
+            }
+            if(kind == 0) {
+                tree.checkpoint();
+            }
+            else if(kind == 1) {
+                tree.checkpointDelta();
+            }
+            else {
+                tree.checkpointDelta();
+                tree.compact();
+            }
+            for(size_t i = 0; i < n / 4; i++) {
+                mutate(tree, model, (long)i, keys, rng);
+            }
+            tree.commit();
+        }
+        DurableTree reopened(WAL_SNAPSHOT, WAL_LOG);
+        check(sameAs(reopened.tree(), model), (std::string("reopen after ") + kinds[kind] + " and more logging").c_str());
+    }
+
+    // one record per write, so the log's size marks where each record ends
+    std::map<long, long> before = model;
+    std::vector<std::pair<long, long> > ops;
+    std::vector<off_t> ends;
+    {
+        DurableTree tree(WAL_SNAPSHOT, WAL_LOG, WALOptions(1, 0));
+        ends.push_back(fileSize(WAL_LOG));
+        for(size_t i = 0; i < n / 4; i++) {
+            ops.push_back(mutate(tree, model, (long)i, keys, rng));
+            ends.push_back(fileSize(WAL_LOG));
+        }
+    }
+    size_t whole = ops.size() / 2;
+    off_t cut = ends[whole] + (ends[whole + 1] - ends[whole]) / 2;
+    check(::truncate(WAL_LOG, cut) == 0, "cut the log mid-record");
+    model = before;
+    for(size_t i = 0; i < whole; i++) {
+        if(ops[i].second < 0) {
+            model.erase(ops[i].first);
+        }
+        else {
+            model[ops[i].first] = ops[i].second;
+        }
+    }
+    {
+        DurableTree reopened(WAL_SNAPSHOT, WAL_LOG);
+        check(sameAs(reopened.tree(), model), "reopen after a torn record");
+    }
+
+    uint32_t frame[2] = {0xFFFFFFF0u, 0};
+    std::FILE* log = std::fopen(WAL_LOG, "ab");
+    check(log != NULL && std::fwrite(frame, sizeof(frame), 1, log) == 1 && std::fclose(log) == 0,
+          "append a frame claiming 4 GB");
+    {
+        DurableTree reopened(WAL_SNAPSHOT, WAL_LOG);
+        check(sameAs(reopened.tree(), model), "reopen after an oversized frame");
+        // the torn tail is cut off, so records logged now are replayed
+        for(size_t i = 0; i < n / 4; i++) {
+            mutate(reopened, model, (long)i, keys, rng);
+        }
+        reopened.commit();
+    }
+    DurableTree reopened(WAL_SNAPSHOT, WAL_LOG);
+    check(sameAs(reopened.tree(), model), "reopen after logging past a torn tail");
+    removeWalFiles();
+}
+
+/**
+ * Builds from random keys with repeats, enough items that buildRange()
+ * and the merge sort fork rather than fall through to the serial path,
+ * then walks the tree both ways against the last value of each key.
+ */
+static void parallelBuildTest(size_t n, unsigned threads, bool threaded)
+{
+    cout << "Parallel build of " << n << " items on " << threads << " threads"
+         << (threaded ? ", threaded tree" : "") << endl;
+    std::mt19937 rng(threads);
+    std::vector<std::pair<long, long> > items;
+    std::map<long, long> model;
+    for(size_t i = 0; i < n; i++) {
+        long key = (long)(rng() % (n / 2));
+        items.push_back(std::make_pair(key, (long)i));
+        model[key] = (long)i;
+    }
+    AVLTree<long, long> tree(false, threaded);
+    ParallelBuilder<long, long>(threads).build(tree, items);
+
+    check(tree.isBalanced(), "isBalanced() after parallel build");
+    check(sameAs(tree, model), "forward order and values match std::map");
+    bool reverse = true;
+    std::map<long, long>::const_reverse_iterator expected = model.rbegin();
+    for(AVLTree<long, long>::reverse_iterator it = tree.rbegin(); it != tree.rend() && reverse; ++it, ++expected) {
+        reverse = (expected != model.rend() && it->first == expected->first && it->second == expected->second);
+    }
+    check(reverse && expected == model.rend(), "reverse order matches std::map");
+    check(tree.min().first == model.begin()->first && tree.max().first == model.rbegin()->first,
+          "min() and max() after parallel build");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t depth = 10000000;
+    if(argc > 1) {
+        depth = strtoul(argv[1], NULL, 10);
+    }
+    chainTest(depth, true);
+    chainTest(depth, false);
+    avlTest(depth / 10);
+    walTest(std::max(depth / 1000, (size_t)16));
+    // odd, so the halves at each fork differ by one
+    size_t parallelItems = 8 * PARALLEL_GRAIN + 1;
+    parallelBuildTest(parallelItems, 2, false);
+    parallelBuildTest(parallelItems, 4, false);
+    parallelBuildTest(parallelItems, 4, true);
+
+    cout << (failures == 0 ? "All stress tests passed" : "Stress tests FAILED") << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -1,7 +1,18 @@
 #include <iostream>
 #include <map>
+#include <cstdio>
 #include "bst.h"
 #include "avlbst.h"
+#include "augmented_avl.h"
+#include "interval_tree.h"
+#include "avlset.h"
+#include "compact_avl.h"
+#include "parentless_avl.h"
+#include "mapped_avl.h"
+#include "wal.h"
+#include "external_build.h"
+#include "parallel_build.h"
+#include "parallel_traversal.h"
 
 using namespace std;
 
@@ -26,6 +37,15 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     bt.remove('b');
 
+    // sorted inserts degrade into a list until rebalance() runs
+    BinarySearchTree<int,int> chain;
+    for(int i = 0; i < 100; i++) {
+        chain.insert(std::make_pair(i, i));
+    }
+    cout << "\nSorted BST balanced before rebalance: " << chain.isBalanced() << endl;
+    chain.rebalance();
+    cout << "Sorted BST balanced after rebalance: " << chain.isBalanced() << endl;
+
     // AVL Tree Tests
     AVLTree<char,int> at;
     at.insert(std::make_pair('a',1));
@@ -44,5 +64,193 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Threaded mode walks next links instead of climbing parents
+    AVLTree<int,int> threaded(false, true);
+    for(int i = 0; i < 8; i++) {
+        threaded.insert(std::make_pair((i * 5) % 8, i));
+    }
+    threaded.remove(4);
+    cout << "\nThreaded AVLTree keys:";
+    for(AVLTree<int,int>::iterator it = threaded.begin(); it != threaded.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    cout << "Threaded AVLTree size " << threaded.size() << ", min " << threaded.min().first
+         << ", max " << threaded.max().first << endl;
+
+    // Work-queue use: take the smallest item without searching for it
+    std::pair<int,int> first = threaded.extract_min();
+    threaded.pop_max();
+    cout << "Extracted " << first.first << ", next up " << threaded.peek().first
+         << ", " << threaded.size() << " left" << endl;
+
+    // Newest entries first without copying the tree
+    cout << "Largest three keys:";
+    int shown = 0;
+    for(AVLTree<int,int>::reverse_iterator it = threaded.rbegin(); it != threaded.rend() && shown < 3; ++it, ++shown) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Move a node between trees without reallocating it
+    AVLTree<int,int> pending;
+    pending.insert(std::make_pair(100, 1));
+    pending.insert(std::make_pair(200, 2));
+    AVLTree<int,int> active;
+    active.insert(pending.extract(100));
+    active.merge(pending);
+    cout << "Active keys after moving:";
+    for(AVLTree<int,int>::iterator it = active.begin(); it != active.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << ", pending " << pending.size() << endl;
+
+    // Snapshot round trip: load() rebuilds a balanced tree in one pass
+    active.save("bst-test-snapshot.bin");
+    AVLTree<int,int> restored;
+    restored.load("bst-test-snapshot.bin");
+    std::remove("bst-test-snapshot.bin");
+    cout << "Restored " << restored.size() << " items, max key " << restored.max().first << endl;
+
+    // Read-only view served from the mapped file, nothing copied
+    MappedAVLTree<int,int>::write("bst-test-image.bin", restored);
+    {
+        MappedAVLTree<int,int> image("bst-test-image.bin");
+        cout << "Mapped image value at 200: " << image[200] << endl;
+    }
+    std::remove("bst-test-image.bin");
+
+    // Mutations survive a restart through the write-ahead log
+    {
+        DurableAVLTree<int,int> durable("bst-test-wal.snap", "bst-test-wal.log");
+        durable.insert(std::make_pair(1, 10));
+        durable.insert(std::make_pair(2, 20));
+        durable.remove(1);
+        durable.commit();
+    }
+    {
+        DurableAVLTree<int,int> reopened("bst-test-wal.snap", "bst-test-wal.log");
+        cout << "Recovered " << reopened.tree().size() << " item from " << reopened.recoveredRecords()
+             << " log records" << endl;
+    }
+    std::remove("bst-test-wal.log");
+    std::remove("bst-test-wal.snap.lock");
+
+    // Sort in bounded memory through run files, then build in one pass
+    {
+        ExternalSorter<int,int> sorter(64);
+        for(int i = 0; i < 10; i++) {
+            sorter.add((i * 7) % 5, i);
+        }
+        AVLTree<int,int> sorted;
+        sorter.build(sorted);
+        cout << "Externally sorted " << sorter.added() << " items through " << sorter.runs()
+             << " runs:";
+        for(AVLTree<int,int>::iterator it = sorted.begin(); it != sorted.end(); ++it) {
+            cout << " " << it->first << "=" << it->second;
+        }
+        cout << endl;
+    }
+
+    // Sort and build on several threads; the last value for a key wins
+    std::vector<std::pair<int,int> > unsorted;
+    for(int i = 0; i < 6; i++) {
+        unsorted.push_back(std::make_pair(5 - i % 4, i));
+    }
+    AVLTree<int,int> built;
+    ParallelBuilder<int,int>(2).build(built, unsorted);
+    cout << "Built in parallel:";
+    for(AVLTree<int,int>::iterator it = built.begin(); it != built.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+    std::vector<std::pair<int,int> > exported = to_vector(built, 2);
+    cout << "Exported " << exported.size() << " items in order, first key " << exported[0].first << endl;
+
+    // Multimap mode keeps repeated keys in insertion order
+    AVLTree<int,char> events(true);
+    events.insert(std::make_pair(7, 'a'));
+    events.insert(std::make_pair(3, 'b'));
+    events.insert(std::make_pair(7, 'c'));
+    cout << "\nEvents at 7 (" << events.count(7) << "):";
+    std::pair<AVLTree<int,char>::iterator, AVLTree<int,char>::iterator> range = events.equal_range(7);
+    for(AVLTree<int,char>::iterator it = range.first; it != range.second; ++it) {
+        cout << " " << it->second;
+    }
+    cout << endl;
+
+    // Key-only set
+    AVLSet<int> seen;
+    seen.insert(5);
+    seen.insert(2);
+    seen.insert(5);
+    cout << "Set contents (" << seen.size() << "):";
+    for(AVLSet<int>::iterator it = seen.begin(); it != seen.end(); ++it) {
+        cout << " " << *it;
+    }
+    cout << endl;
+
+    // Index-linked pool of nodes
+    CompactAVLTree<unsigned,unsigned> ids;
+    for(unsigned i = 0; i < 5; i++) {
+        ids.insert(std::make_pair(i * 3, i));
+    }
+    ids.remove(6);
+    ids[9] = 42;
+    cout << "Compact tree contents (" << ids.size() << "):";
+    for(CompactAVLTree<unsigned,unsigned>::iterator it = ids.begin(); it != ids.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // No parent pointers; iterators keep their own stack
+    ParentlessAVLTree<int,char> letters;
+    for(int i = 0; i < 6; i++) {
+        letters.insert(std::make_pair(5 - i, (char)('a' + i)));
+    }
+    letters.remove(2);
+    cout << "Parentless tree from 3:";
+    for(ParentlessAVLTree<int,char>::iterator it = letters.find(3); it != letters.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // Range sums in O(log n)
+    AugmentedAVLTree<int,int,SumMonoid<int> > sums;
+    for(int i = 1; i <= 10; i++) {
+        sums.insert(std::make_pair(i, i * 10));
+    }
+    cout << "Sum of values for keys 3..6: " << sums.aggregate(3, 6) << endl;
+
+    // Interval tree stabbing query
+    IntervalTree<int,char> windows;
+    windows.insert(1, 5, 'x');
+    windows.insert(4, 9, 'y');
+    windows.insert(10, 12, 'z');
+    std::vector<IntervalTree<int,char>::iterator> hits;
+    windows.stab(4, hits);
+    cout << "Intervals containing 4:";
+    for(size_t i = 0; i < hits.size(); i++) {
+        cout << " " << hits[i]->first << "=" << hits[i]->second;
+    }
+    cout << endl;
+
+    // Event counters; all zero unless built with DEFS=-DBST_STATS
+    AVLTree<int,int> counted;
+    for(int i = 1; i <= 7; i++) {
+        counted.insert(std::make_pair(i, i));
+    }
+    counted.find(5);
+    counted.remove(1);
+    TreeStats stats = counted.stats();
+    cout << "Rotations for 7 ascending inserts: " << stats[TREE_STATS_INSERT].rotations
+         << ", comparisons to find 5: " << stats[TREE_STATS_FIND].comparisons << endl;
+
+    // Latency histograms; empty unless built with DEFS=-DBST_LATENCY
+    counted[3] = 30;
+    cout << "Timed operator[] calls: " << counted.latency()[TREE_STATS_INDEX].count << endl;
+    cout << counted.latency();
+
     return 0;
 }
@@ -4,7 +4,28 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cmath>
+#include <stdexcept>
 #include <utility>
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <typeinfo>
+#include <string>
+#include "snapshot.h"
+#include "tree_stats.h"
+
+// Software prefetch hint used by the batched lookups
+#if defined(__GNUC__) || defined(__clang__)
+#define BST_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define BST_PREFETCH(addr) ((void)0)
+#endif
+
+// Number of lookups find_many() keeps in flight at once
+#ifndef BST_FIND_MANY_LANES
+#define BST_FIND_MANY_LANES 16
+#endif
 
 /**
  * A templated class for a Node in a search tree.
@@ -13,6 +34,20 @@
  * search trees, such as Red Black trees, Splay trees,
  * and AVL trees.
  */
+template <typename Key, typename Value>
+class Node;
+
+/**
+ * In-order neighbour links kept by nodes of a threaded tree, so the
+ * iterator can step to the next node without climbing parent pointers.
+ */
+template <typename Key, typename Value>
+struct ThreadLinks
+{
+    Node<Key, Value>* next;
+    Node<Key, Value>* prev;
+};
+
 template <typename Key, typename Value>
 class Node
 {
@@ -29,6 +64,8 @@ public:
     virtual Node<Key, Value>* getParent() const;
     virtual Node<Key, Value>* getLeft() const;
     virtual Node<Key, Value>* getRight() const;
+    // NULL unless the node belongs to a threaded tree
+    virtual ThreadLinks<Key, Value>* getThreads();
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
@@ -144,6 +181,15 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
     return right_;
 }
 
+/**
+* Plain nodes carry no in-order links.
+*/
+template<typename Key, typename Value>
+ThreadLinks<Key, Value>* Node<Key, Value>::getThreads()
+{
+    return NULL;
+}
+
 /**
 * A setter for setting the parent of a node.
 */
@@ -186,14 +232,55 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* Adds in-order next/prev links to a node type (Node or AVLNode).
+* Threaded trees allocate these instead of the plain node.
+*/
+template <typename Key, typename Value, typename Base>
+class ThreadedNode : public Base
+{
+public:
+    ThreadedNode(const Key& key, const Value& value, Base* parent);
+
+    virtual ThreadLinks<Key, Value>* getThreads() override;
+
+protected:
+    ThreadLinks<Key, Value> threads_;
+};
+
+template <typename Key, typename Value, typename Base>
+ThreadedNode<Key, Value, Base>::ThreadedNode(const Key& key, const Value& value, Base* parent) :
+    Base(key, value, parent)
+{
+    threads_.next = NULL;
+    threads_.prev = NULL;
+}
+
+template <typename Key, typename Value, typename Base>
+ThreadLinks<Key, Value>* ThreadedNode<Key, Value, Base>::getThreads()
+{
+    return &threads_;
+}
+
+// build and walk trees on several threads (parallel_build.h,
+// parallel_traversal.h)
+template <typename Key, typename Value>
+class ParallelBuilder;
+template <typename Key, typename Value>
+class ParallelTraversal;
+
 /**
 * A templated unbalanced binary search tree.
 */
 template <typename Key, typename Value>
-class BinarySearchTree
+class BinarySearchTree : protected TreeStatsPolicy
 {
 public:
-    BinarySearchTree(); //TODO
+    // allowDuplicates turns on multimap mode: equal keys are all kept, in
+    // insertion order, instead of insert() overwriting the value.
+    // threaded gives every node next/prev links so ++ is O(1) worst case,
+    // at 16 more bytes per node.
+    explicit BinarySearchTree(bool allowDuplicates = false, bool threaded = false); //TODO
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
@@ -201,16 +288,57 @@ public:
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    size_t size() const;
+    // smallest / largest item in O(1); throw std::out_of_range when empty.
+    // Only a non-const tree hands out a writable value.
+    const std::pair<const Key, Value>& min() const;
+    const std::pair<const Key, Value>& max() const;
+    std::pair<const Key, Value>& min();
+    std::pair<const Key, Value>& max();
+
+    // Priority-queue use: the front is the smallest item (the oldest one
+    // among equal keys in multimap mode). These unlink the cached endpoint
+    // directly -- no search -- and rebalancing starts at its parent. All
+    // throw std::out_of_range when empty.
+    const std::pair<const Key, Value>& peek() const;
+    void pop_min();
+    void pop_max();
+    std::pair<Key, Value> extract_min();
+    std::pair<Key, Value> extract_max();
+
+    // Day-Stout-Warren rebuild of the whole tree into a complete tree
+    virtual void rebalance();
+    // Scapegoat mode: rebuild a subtree whenever an insert lands deeper
+    // than log_{1/alpha}(n). Pass 0 to turn it back off.
+    void setAutoRebalance(double alpha);
+    // comparison, rotation and fix-up counters per operation (see
+    // tree_stats.h); always zero unless built with -DBST_STATS
+    TreeStats stats() const;
+    void resetStats();
+    // p50/p99/p99.9/max latency per operation; always zero unless built
+    // with -DBST_LATENCY
+    TreeLatency latency() const;
+    void resetLatency();
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    friend class ParallelBuilder<Key, Value>;
+    friend class ParallelTraversal<Key, Value>;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: -- steps back with predecessor(), and end()
+    * can be decremented to reach the largest item.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,24 +348,146 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
         friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value>* tree);
         Node<Key, Value> *current_;
+        // needed to step back from end()
+        const BinarySearchTree<Key, Value> *tree_;
+    };
+
+    /**
+    * The read-only counterpart of iterator. Any iterator converts to it.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * Owns one node taken out of a tree by extract(). insert() links the
+    * same node into another tree of the same kind with no allocation or
+    * copy; a handle that is never inserted frees its node.
+    */
+    class node_type
+    {
+    public:
+        node_type();
+        node_type(node_type&& other);
+        node_type& operator=(node_type&& other);
+        ~node_type();
+
+        bool empty() const;
+        explicit operator bool() const;
+        const Key& key() const;
+        Value& mapped() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        node_type(Node<Key, Value>* node, const BinarySearchTree<Key, Value>* tree);
+        Node<Key, Value>* node_;
+        // the tree class and node layout the node came from
+        const std::type_info* origin_;
+        bool threaded_;
+
+    private:
+        node_type(const node_type&);
+        node_type& operator=(const node_type&);
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    // reverse order, largest first -- the first K take O(log n + K)
+    reverse_iterator rbegin();
+    reverse_iterator rend();
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    // remove() takes out the oldest element with the key, erase() a given one
+    iterator erase(iterator pos);
+    size_t count(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+
+    // Move nodes between trees of the same class and mode without
+    // reallocating. extract() returns an empty handle when the key is
+    // missing. insert(node_type&&) returns an iterator to the new item,
+    // or in map mode to the item already holding the key, in which case
+    // the handle keeps its node. Both throw std::invalid_argument for a
+    // node from a different kind of tree.
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
+    iterator insert(node_type&& handle);
+    // moves every node of other in; in map mode keys already here stay
+    // behind in other
+    void merge(BinarySearchTree<Key, Value>& other);
+
+    // Binary snapshots (layout in snapshot.h). save() writes the items in
+    // key order, to a temporary file renamed over path once it is synced,
+    // so a failed or interrupted save leaves the previous snapshot.
+    // load() replaces the contents with a balanced tree built in one
+    // linear pass, with no comparisons beyond an order check. A
+    // missing or malformed file throws std::runtime_error, keys out of
+    // order (or repeated, in map mode) std::invalid_argument; if the
+    // failure comes part way through load(), the tree is left empty.
+    template<typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+    void save(const std::string& path) const;
+    template<typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+    void load(const std::string& path);
+    // the same linear build from count items from first on, which must be
+    // in key order (std::invalid_argument otherwise, leaving the tree
+    // empty); first only needs ->first, ->second and ++
+    template<typename InputIterator>
+    void assignSorted(InputIterator first, size_t count);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    Node<Key, Value>* upperBound(const Key& k) const;
+    // unlinks and frees one node
+    void removeNode(Node<Key, Value>* findNode);
+    // link in / take out one node without allocating or freeing it --
+    // derived trees rebalance here
+    virtual void linkNode(Node<Key, Value>* node);
+    virtual void unlinkNode(Node<Key, Value>* node);
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -245,16 +495,71 @@ protected:
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    // derived trees override this to allocate their own node type
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    // lets derived trees hand out iterators to nodes they found themselves
+    iterator makeIterator(Node<Key, Value>* node) const;
 
     // Add helper functions here
     static Node<Key, Value> *successor(Node<Key, Value> *current);
+    // successor()/predecessor(), through the thread links when the tree
+    // is threaded; the flag saves a virtual getThreads() call per step
+    // on the (usual) unthreaded tree
+    static Node<Key, Value> *nextNode(Node<Key, Value> *current, bool threaded);
+    static Node<Key, Value> *prevNode(Node<Key, Value> *current, bool threaded);
+
+    // threaded mode: splice a newly linked node into the in-order list,
+    // take one out, or swap two nodes' places in it
+    static void threadIn(Node<Key, Value>* node);
+    // call once a new node is linked in, and just before a node with at
+    // most one child is unlinked: they keep the cached endpoints and the
+    // thread links up to date
+    void nodeLinked(Node<Key, Value>* node);
+    void nodeUnlinking(Node<Key, Value>* node);
+    // throws unless nodes from origin fit this tree
+    void checkCompatible(const std::type_info& origin, bool threaded) const;
+    static void threadOut(Node<Key, Value>* node);
+    static void threadSwap(Node<Key, Value>* n1, Node<Key, Value>* n2);
+    static void threadLink(Node<Key, Value>* before, Node<Key, Value>* after);
     // isBalanced Helpter
     bool isBalancedHelper(Node<Key, Value> *curr) const;
     int getHeight(Node<Key, Value> *temp) const;
 
+    // rebalance helpers
+    Node<Key, Value>* rebuildSubtree(Node<Key, Value>* subRoot);
+    static Node<Key, Value>* compressVine(Node<Key, Value>* head, size_t times);
+    static size_t subtreeSize(Node<Key, Value>* subRoot);
+
+    // Builds a perfectly balanced subtree from the next count items of
+    // source (called as source(key, value), in key order). prev is the
+    // node built last, for threading and the order check; height comes
+    // back through the last argument.
+    template<typename Source>
+    Node<Key, Value>* buildSorted(size_t count, Source& source, Node<Key, Value>*& prev, int& height);
+    // clears the tree and makes it the count items of source
+    template<typename Source>
+    void buildFrom(size_t count, Source& source);
+    // takes over a subtree built from count items, last being its
+    // rightmost node, as the whole contents of an empty tree
+    void adoptBuilt(Node<Key, Value>* root, size_t count, Node<Key, Value>* last);
+    // called on each node once its subtrees are built, so derived trees
+    // can fill in their per-node data
+    virtual void builtNode(Node<Key, Value>* node, int leftHeight, int rightHeight);
+    // frees a detached subtree in O(n) without recursion
+    static void deleteSubtree(Node<Key, Value>* subRoot);
+
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    size_t size_;
+    size_t maxSize_;   // largest size_ since the last full rebuild (scapegoat)
+    double alpha_;     // 0 when scapegoat mode is off
+    bool multi_;       // duplicate keys allowed
+    bool threaded_;    // nodes carry in-order next/prev links
+    // cached endpoints: kept by insert, removeNode and nodeSwap. Rotations
+    // and rebuilds never change in-order order, so they leave them alone.
+    Node<Key, Value>* leftmost_;
+    Node<Key, Value>* rightmost_;
 };
 
 /*
@@ -267,10 +572,11 @@ Begin implementations for the BinarySearchTree::iterator class.
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
 template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value>* tree)
 {
     // TODO
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
@@ -281,6 +587,7 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 {
     // TODO
     current_ = nullptr;
+    tree_ = nullptr;
 }
 
 /**
@@ -338,9 +645,45 @@ BinarySearchTree<Key, Value>::iterator::operator++()
 {
     // TODO
     // inorder --- lnr -- successor
-    current_ = successor(current_);
+    current_ = nextNode(current_, tree_->threaded_);
+    return *this;
+
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iterator::operator++(int)
+{
+    iterator old = *this;
+    ++(*this);
+    return old;
+}
+
+/**
+* Moves back to the previous item; from end() that is the largest item
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator&
+BinarySearchTree<Key, Value>::iterator::operator--()
+{
+    if (current_ == nullptr)
+    {
+        current_ = tree_->getLargestNode();
+    }
+    else
+    {
+        current_ = prevNode(current_, tree_->threaded_);
+    }
     return *this;
+}
 
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iterator::operator--(int)
+{
+    iterator old = *this;
+    --(*this);
+    return old;
 }
 
 
@@ -350,6 +693,167 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+-------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+-------------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::const_iterator::const_iterator()
+{
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::const_iterator::const_iterator(const iterator& it) : it_(it)
+{
+}
+
+template<class Key, class Value>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value>::const_iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_iterator&
+BinarySearchTree<Key, Value>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_iterator
+BinarySearchTree<Key, Value>::const_iterator::operator++(int)
+{
+    const_iterator old = *this;
+    ++it_;
+    return old;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_iterator&
+BinarySearchTree<Key, Value>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_iterator
+BinarySearchTree<Key, Value>::const_iterator::operator--(int)
+{
+    const_iterator old = *this;
+    --it_;
+    return old;
+}
+
+/*
+-----------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+-----------------------------------------------------------------
+*/
+
+/*
+--------------------------------------------------------------
+Begin implementations for the BinarySearchTree::node_type class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::node_type() : node_(nullptr), origin_(nullptr), threaded_(false)
+{
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::node_type(Node<Key, Value>* node, const BinarySearchTree<Key, Value>* tree) :
+    node_(node),
+    origin_(&typeid(*tree)),
+    threaded_(tree->threaded_)
+{
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::node_type(node_type&& other) :
+    node_(other.node_),
+    origin_(other.origin_),
+    threaded_(other.threaded_)
+{
+    other.node_ = nullptr;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::node_type&
+BinarySearchTree<Key, Value>::node_type::operator=(node_type&& other)
+{
+    if (this != &other)
+    {
+        delete node_;
+        node_ = other.node_;
+        origin_ = other.origin_;
+        threaded_ = other.threaded_;
+        other.node_ = nullptr;
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::~node_type()
+{
+    delete node_;
+}
+
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::node_type::empty() const
+{
+    return node_ == nullptr;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::operator bool() const
+{
+    return node_ != nullptr;
+}
+
+template<class Key, class Value>
+const Key& BinarySearchTree<Key, Value>::node_type::key() const
+{
+    return node_->getKey();
+}
+
+template<class Key, class Value>
+Value& BinarySearchTree<Key, Value>::node_type::mapped() const
+{
+    return node_->getValue();
+}
+
+/*
+------------------------------------------------------------
+End implementations for the BinarySearchTree::node_type class.
+------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -360,10 +864,17 @@ Begin implementations for the BinarySearchTree class.
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
 template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+BinarySearchTree<Key, Value>::BinarySearchTree(bool allowDuplicates, bool threaded) 
 {
     // TODO
     root_ = nullptr;
+    leftmost_ = nullptr;
+    rightmost_ = nullptr;
+    size_ = 0;
+    maxSize_ = 0;
+    alpha_ = 0.0;
+    multi_ = allowDuplicates;
+    threaded_ = threaded;
 }
 
 template<typename Key, typename Value>
@@ -382,6 +893,92 @@ bool BinarySearchTree<Key, Value>::empty() const
     return root_ == NULL;
 }
 
+/**
+ * Returns the number of items, kept as a counter so this is O(1)
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& BinarySearchTree<Key, Value>::min() const
+{
+    if(leftmost_ == NULL) throw std::out_of_range("Empty tree");
+    return static_cast<const Node<Key, Value> *>(leftmost_)->getItem();
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& BinarySearchTree<Key, Value>::max() const
+{
+    if(rightmost_ == NULL) throw std::out_of_range("Empty tree");
+    return static_cast<const Node<Key, Value> *>(rightmost_)->getItem();
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& BinarySearchTree<Key, Value>::min()
+{
+    if(leftmost_ == NULL) throw std::out_of_range("Empty tree");
+    return leftmost_->getItem();
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& BinarySearchTree<Key, Value>::max()
+{
+    if(rightmost_ == NULL) throw std::out_of_range("Empty tree");
+    return rightmost_->getItem();
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& BinarySearchTree<Key, Value>::peek() const
+{
+    return min();
+}
+
+/**
+ * The leftmost node never has a left child, so removeNode() skips the
+ * predecessor swap and unlinks it in place.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::pop_min()
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    if(leftmost_ == NULL) throw std::out_of_range("Empty tree");
+    removeNode(leftmost_);
+}
+
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::pop_max()
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    if(rightmost_ == NULL) throw std::out_of_range("Empty tree");
+    removeNode(rightmost_);
+}
+
+/**
+ * Removes the smallest item and returns it (the value is moved out)
+*/
+template<class Key, class Value>
+std::pair<Key, Value> BinarySearchTree<Key, Value>::extract_min()
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    if(leftmost_ == NULL) throw std::out_of_range("Empty tree");
+    std::pair<Key, Value> item(leftmost_->getKey(), std::move(leftmost_->getValue()));
+    removeNode(leftmost_);
+    return item;
+}
+
+template<class Key, class Value>
+std::pair<Key, Value> BinarySearchTree<Key, Value>::extract_max()
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    if(rightmost_ == NULL) throw std::out_of_range("Empty tree");
+    std::pair<Key, Value> item(rightmost_->getKey(), std::move(rightmost_->getValue()));
+    removeNode(rightmost_);
+    return item;
+}
+
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::print() const
 {
@@ -396,7 +993,7 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
@@ -407,87 +1004,494 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value>::iterator end(NULL, this);
     return end;
 }
 
-/**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
-*/
 template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+typename BinarySearchTree<Key, Value>::const_iterator
+BinarySearchTree<Key, Value>::cbegin() const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    return const_iterator(begin());
 }
 
-/**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
 template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+typename BinarySearchTree<Key, Value>::const_iterator
+BinarySearchTree<Key, Value>::cend() const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return const_iterator(end());
 }
+
 template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+typename BinarySearchTree<Key, Value>::reverse_iterator
+BinarySearchTree<Key, Value>::rbegin()
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return reverse_iterator(end());
 }
 
-/**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
-*/
 template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+typename BinarySearchTree<Key, Value>::const_reverse_iterator
+BinarySearchTree<Key, Value>::rbegin() const
 {
-    // TODO
-    // if empty add the root node and leave
-    if (root_ == nullptr)
-    {
-        // new node = Node( key, value, parent);
-        root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
+    return crbegin();
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::reverse_iterator
+BinarySearchTree<Key, Value>::rend()
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_reverse_iterator
+BinarySearchTree<Key, Value>::rend() const
+{
+    return crend();
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_reverse_iterator
+BinarySearchTree<Key, Value>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::const_reverse_iterator
+BinarySearchTree<Key, Value>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(const Key & k) const
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_FIND);
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value>::iterator it(curr, this);
+    return it;
+}
+
+/**
+* Removes the element the iterator points at and returns an iterator
+* to the element after it
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator pos)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    // the swap in removeNode moves nodes around but never frees the successor
+    Node<Key, Value> *next = nextNode(pos.current_, threaded_);
+    removeNode(pos.current_);
+    return iterator(next, this);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::node_type
+BinarySearchTree<Key, Value>::extract(const Key& key)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    Node<Key, Value> *node = internalFind(key);
+    if (node == nullptr)
+    {
+        return node_type();
+    }
+    unlinkNode(node);
+    return node_type(node, this);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::node_type
+BinarySearchTree<Key, Value>::extract(iterator pos)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
+    unlinkNode(pos.current_);
+    return node_type(pos.current_, this);
+}
+
+/**
+* Nodes are laid out by the tree class that made them (Node, AVLNode,
+* AugmentedAVLNode, ...) and by threaded mode, so both have to match.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::checkCompatible(const std::type_info& origin, bool threaded) const
+{
+    if (origin != typeid(*this) || threaded != threaded_)
+    {
+        throw std::invalid_argument("Node comes from a different kind of tree");
+    }
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insert(node_type&& handle)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_INSERT);
+    if (handle.empty())
+    {
+        return end();
+    }
+    checkCompatible(*handle.origin_, handle.threaded_);
+    Node<Key, Value> *existing = multi_ ? nullptr : internalFind(handle.key());
+    if (existing != nullptr)
+    {
+        return iterator(existing, this);
+    }
+    Node<Key, Value> *node = handle.node_;
+    handle.node_ = nullptr;
+    linkNode(node);
+    return iterator(node, this);
+}
+
+/**
+* Walks other in order, unlinking each node there and linking it in here.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::merge(BinarySearchTree<Key, Value>& other)
+{
+    if (&other == this)
+    {
+        return;
+    }
+    checkCompatible(typeid(other), other.threaded_);
+    Node<Key, Value> *curr = other.leftmost_;
+    while (curr != nullptr)
+    {
+        Node<Key, Value> *next = nextNode(curr, other.threaded_);
+        if (multi_ || internalFind(curr->getKey()) == nullptr)
+        {
+            other.unlinkNode(curr);
+            linkNode(curr);
+        }
+        curr = next;
+    }
+}
+
+/**
+* Header with the item count, then the items from leftmost_ along
+* nextNode(), written beside path and published with publishFile().
+*/
+template<class Key, class Value>
+template<typename KeyCodec, typename ValueCodec>
+void BinarySearchTree<Key, Value>::save(const std::string& path) const
+{
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.count = size_;
+
+    std::string temp = snapshotTempPath(path);
+    try
+    {
+        SnapshotWriter out(temp);
+        out.write(&header, sizeof(header));
+        for (Node<Key, Value> *curr = leftmost_; curr != nullptr; curr = nextNode(curr, threaded_))
+        {
+            KeyCodec::write(out, curr->getKey());
+            ValueCodec::write(out, curr->getValue());
+        }
+        out.close();
+    }
+    catch (...)
+    {
+        std::remove(temp.c_str());
+        throw;
+    }
+    publishFile(temp, path);
+}
+
+/**
+* Checks the header before touching the tree, then rebuilds it straight
+* from the stream with buildSorted().
+*/
+template<class Key, class Value>
+template<typename KeyCodec, typename ValueCodec>
+void BinarySearchTree<Key, Value>::load(const std::string& path)
+{
+    struct StreamSource
+    {
+        SnapshotReader *in;
+        void operator()(Key& key, Value& value)
+        {
+            KeyCodec::read(*in, key);
+            ValueCodec::read(*in, value);
+        }
+    };
+
+    SnapshotReader in(path);
+    SnapshotHeader header;
+    in.read(&header, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION)
+    {
+        throw std::runtime_error(path + " is not a tree snapshot");
+    }
+    if (header.keySize != sizeof(Key) || header.valueSize != sizeof(Value))
+    {
+        throw std::runtime_error(path + " holds different key or value types");
+    }
+
+    StreamSource source;
+    source.in = &in;
+    buildFrom((size_t)header.count, source);
+}
+
+template<class Key, class Value>
+template<typename InputIterator>
+void BinarySearchTree<Key, Value>::assignSorted(InputIterator first, size_t count)
+{
+    struct IteratorSource
+    {
+        InputIterator *next;
+        void operator()(Key& key, Value& value)
+        {
+            key = (*next)->first;
+            value = (*next)->second;
+            ++(*next);
+        }
+    };
+
+    IteratorSource source;
+    source.next = &first;
+    buildFrom(count, source);
+}
+
+/**
+* Returns the number of elements with the given key
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::count(const Key& key) const
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_FIND);
+    size_t total = 0;
+    Node<Key, Value> *curr = internalFind(key);
+    while (curr != nullptr && curr->getKey() == key)
+    {
+        total++;
+        curr = nextNode(curr, threaded_);
+    }
+    return total;
+}
+
+/**
+* Returns the range [first element with key, first element past key),
+* which is empty when the key is missing
+*/
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, typename BinarySearchTree<Key, Value>::iterator>
+BinarySearchTree<Key, Value>::equal_range(const Key& key) const
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_FIND);
+    Node<Key, Value> *first = internalFind(key);
+    Node<Key, Value> *last = upperBound(key);
+    return std::make_pair(iterator(first != nullptr ? first : last, this), iterator(last, this));
+}
+
+/**
+* Wraps a node in an iterator (the constructor is only open to this class).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* Looks up every key in keys and stores the matching iterator (or end())
+* at the same index of out. Up to BST_FIND_MANY_LANES searches descend in
+* lockstep, one level per round, and each prefetches the node it will
+* read next round, so the cache misses of independent searches overlap
+* instead of being paid one after another.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_OTHER);
+    out.assign(keys.size(), end());
+    if (root_ == nullptr)
+    {
         return;
     }
+
+    Node<Key, Value> *cursor[BST_FIND_MANY_LANES];
+    size_t slot[BST_FIND_MANY_LANES];
+    size_t active = 0;
+    size_t next = 0;
+
+    // start the first group -- they all begin at the root
+    while (active < BST_FIND_MANY_LANES && next < keys.size())
+    {
+        cursor[active] = root_;
+        slot[active] = next++;
+        active++;
+    }
+
+    while (active > 0)
+    {
+        size_t lane = 0;
+        while (lane < active)
+        {
+            Node<Key, Value> *curr = cursor[lane];
+            const Key &key = keys[slot[lane]];
+            bool done = false;
+            if (curr != nullptr)
+            {
+                this->countVisit();
+                this->countComparison();
+            }
+            if (curr == nullptr)
+            {
+                done = true;
+            }
+            else if (curr->getKey() == key)
+            {
+                out[slot[lane]] = iterator(curr, this);
+                // multimap mode keeps going for the oldest match
+                done = !multi_;
+                curr = curr->getLeft();
+                BST_PREFETCH(curr);
+                cursor[lane] = curr;
+            }
+            else
+            {
+                this->countComparison();
+                curr = (curr->getKey() < key) ? curr->getRight() : curr->getLeft();
+                BST_PREFETCH(curr);
+                cursor[lane] = curr;
+            }
+
+            if (!done)
+            {
+                lane++;
+            }
+            // finished -- hand the lane the next key, or retire it
+            else if (next < keys.size())
+            {
+                cursor[lane] = root_;
+                slot[lane] = next++;
+                lane++;
+            }
+            else
+            {
+                active--;
+                cursor[lane] = cursor[active];
+                slot[lane] = slot[active];
+            }
+        }
+    }
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_INDEX);
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value>
+Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_INDEX);
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* Allocates a plain (or threaded) node for the unbalanced tree.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    if (threaded_)
+    {
+        return new ThreadedNode<Key, Value, Node<Key, Value> >(key, value, parent);
+    }
+    return new Node<Key, Value>(key, value, parent);
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_INSERT);
+    // TODO
     // find item -- if it exists overwrite current value with the updated value
     // key exists
-    if (internalFind(keyValuePair.first))
+    // (multimap mode keeps the old one and adds the new one after it)
+    Node<Key, Value> *existing = multi_ ? nullptr : internalFind(keyValuePair.first);
+    if (existing)
+    {
+        existing->setValue(keyValuePair.second);
+        return;
+    }
+    linkNode(createNode(keyValuePair.first, keyValuePair.second, nullptr));
+}
+
+/**
+* Links a detached node in as a new leaf, whatever its old links were.
+* Does not check for an existing key.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::linkNode(Node<Key, Value>* insertNode)
+{
+    insertNode->setParent(nullptr);
+    insertNode->setLeft(nullptr);
+    insertNode->setRight(nullptr);
+    // if empty add the root node and leave
+    if (root_ == nullptr)
     {
-        internalFind(keyValuePair.first)->setValue(keyValuePair.second);
+        root_ = insertNode;
+        nodeLinked(root_);
+        size_ = 1;
+        maxSize_ = 1;
         return;
     }
     // add accordingly
     Node<Key, Value> *currNode = root_;
-    // Node<Key, Value> *insertNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, currNode);
+    // depth of the new node (root is depth 0) -- needed for scapegoat mode
+    size_t depth = 1;
 
-    while (currNode != nullptr)
+    while (insertNode->getParent() == nullptr)
     {
+        this->countVisit();
+        this->countComparison();
         // go to the left if the insert data is less than
-        if (keyValuePair.first < currNode -> getKey())
+        if (insertNode->getKey() < currNode -> getKey())
         {
             // check if anything is the the left, if not insert
             if (currNode -> getLeft() == nullptr)
             {
                 // make sure to update parent
-                Node<Key, Value> *insertNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, currNode);
                 currNode->setLeft(insertNode);
-                return;
+                insertNode->setParent(currNode);
             }
             // keep going to the left
             else
             {
                 currNode = currNode -> getLeft();
+                depth++;
             }
         }
         // check if needed to go to the right and the insert value is greater
@@ -496,17 +1500,46 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
             // insert to the right if nothing is there
             if (currNode -> getRight() == nullptr)
             {
-                Node<Key, Value> *insertNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, currNode);
                 currNode->setRight(insertNode);
-                return;
+                insertNode->setParent(currNode);
             }
             // keep going to the right
             else
             {
                 currNode = currNode -> getRight();
+                depth++;
             }
         }
     }
+    nodeLinked(insertNode);
+
+    size_++;
+    if (size_ > maxSize_)
+    {
+        maxSize_ = size_;
+    }
+    // scapegoat mode -- only do work when the new node is too deep
+    if (alpha_ == 0.0 || depth <= std::log((double)size_) / std::log(1.0 / alpha_))
+    {
+        return;
+    }
+    // walk up until a child holds more than alpha of its parent's subtree
+    Node<Key, Value> *child = insertNode;
+    size_t childSize = 1;
+    Node<Key, Value> *parent = child->getParent();
+    while (parent != nullptr)
+    {
+        Node<Key, Value> *sibling = (parent->getLeft() == child) ? parent->getRight() : parent->getLeft();
+        size_t parentSize = childSize + 1 + subtreeSize(sibling);
+        if ((double)childSize > alpha_ * (double)parentSize)
+        {
+            rebuildSubtree(parent);
+            return;
+        }
+        child = parent;
+        childSize = parentSize;
+        parent = parent->getParent();
+    }
 }
 
 
@@ -518,6 +1551,7 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::remove(const Key& key)
 {
+    TreeStatsPolicy::Scope scope(*this, TREE_STATS_REMOVE);
     // TODO
     // check if key even exists
     Node<Key, Value> *findNode = internalFind(key);
@@ -527,7 +1561,26 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     {
         return;
     }
+    removeNode(findNode);
+}
+
+/**
+* Removes the given node from the tree (which must contain it) and frees it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* findNode)
+{
+    unlinkNode(findNode);
+    delete findNode;
+}
 
+/**
+* Takes the given node out of the tree (which must contain it) without
+* freeing it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::unlinkNode(Node<Key, Value>* findNode)
+{
     // remove root with 2 children 
 
     // two children -- swap with PREDECESSOR -- then becomes case with 0 or 1 children
@@ -541,6 +1594,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         }
         
     }
+    nodeUnlinking(findNode);
 
     // leaf node -- no children 
     // or write as !findNode -> getLeft()
@@ -563,8 +1617,6 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
             // same thing for the right case
             findNode->getParent() -> setRight(nullptr);
         }
-        delete findNode;
-        return;
     }
 
     // one child
@@ -587,7 +1639,6 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
                 findNode -> getLeft() -> setParent(nullptr);
                 root_ = findNode -> getLeft();
             }
-            delete findNode;
         }
 
         // findNode is the left child of the parent
@@ -606,8 +1657,6 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
                 parent -> setLeft(findNode->getRight());
                 findNode -> getRight() -> setParent(parent);
             }
-
-            delete findNode;
         }
 
         // findNode is thr right child of parent
@@ -632,10 +1681,15 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
                 parent->setRight(findNode->getRight());
                 findNode->getRight()->setParent(parent);
             }
-            delete findNode;
         }
     }
-    
+
+    size_--;
+    // scapegoat mode -- rebuild everything once enough nodes are gone
+    if (alpha_ != 0.0 && (double)size_ < alpha_ * (double)maxSize_)
+    {
+        rebalance();
+    }
 }
 
 template<class Key, class Value>
@@ -700,46 +1754,201 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value> *current)
     }
 }
 
-/**
-* A method to remove all contents of the tree and
-* reset the values in the tree for use again.
-*/
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template <class Key, class Value>
+Node<Key, Value> *
+BinarySearchTree<Key, Value>::nextNode(Node<Key, Value> *current, bool threaded)
 {
-    // TODO
-    while (root_ != nullptr)
+    if (threaded)
     {
-        // reset all key values
-        // pop everything out basically because root is updates
-        remove(root_->getKey());
+        return current->getThreads()->next;
     }
+    return successor(current);
 }
 
-
-/**
-* A helper function to find the smallest node in the tree.
+template <class Key, class Value>
+Node<Key, Value> *
+BinarySearchTree<Key, Value>::prevNode(Node<Key, Value> *current, bool threaded)
+{
+    if (threaded)
+    {
+        return current->getThreads()->prev;
+    }
+    return predecessor(current);
+}
+
+template <class Key, class Value>
+void BinarySearchTree<Key, Value>::threadLink(Node<Key, Value>* before, Node<Key, Value>* after)
+{
+    if (before != NULL)
+    {
+        before->getThreads()->next = after;
+    }
+    if (after != NULL)
+    {
+        after->getThreads()->prev = before;
+    }
+}
+
+/**
+* A new leaf sits right before its parent if it is a left child and
+* right after it otherwise.
+*/
+template <class Key, class Value>
+void BinarySearchTree<Key, Value>::threadIn(Node<Key, Value>* node)
+{
+    ThreadLinks<Key, Value> *links = node->getThreads();
+    Node<Key, Value> *parent = node->getParent();
+    if (links == NULL)
+    {
+        return;
+    }
+    if (parent == NULL)
+    {
+        // a lone root -- clear anything left over from another tree
+        links->next = NULL;
+        links->prev = NULL;
+    }
+    else if (parent->getLeft() == node)
+    {
+        threadLink(parent->getThreads()->prev, node);
+        threadLink(node, parent);
+    }
+    else
+    {
+        threadLink(node, parent->getThreads()->next);
+        threadLink(parent, node);
+    }
+}
+
+/**
+* A new leaf is the new minimum exactly when it hangs left of the old one
+* (or is the root), and the same for the maximum on the right.
+*/
+template <class Key, class Value>
+void BinarySearchTree<Key, Value>::nodeLinked(Node<Key, Value>* node)
+{
+    Node<Key, Value> *parent = node->getParent();
+    if (parent == nullptr)
+    {
+        leftmost_ = node;
+        rightmost_ = node;
+    }
+    else if (parent == leftmost_ && parent->getLeft() == node)
+    {
+        leftmost_ = node;
+    }
+    else if (parent == rightmost_ && parent->getRight() == node)
+    {
+        rightmost_ = node;
+    }
+    threadIn(node);
+}
+
+/**
+* The node has at most one child, so an endpoint's in-order neighbour is
+* what takes its place.
+*/
+template <class Key, class Value>
+void BinarySearchTree<Key, Value>::nodeUnlinking(Node<Key, Value>* node)
+{
+    if (node == leftmost_)
+    {
+        leftmost_ = nextNode(node, threaded_);
+    }
+    if (node == rightmost_)
+    {
+        rightmost_ = prevNode(node, threaded_);
+    }
+    threadOut(node);
+}
+
+template <class Key, class Value>
+void BinarySearchTree<Key, Value>::threadOut(Node<Key, Value>* node)
+{
+    ThreadLinks<Key, Value> *links = node->getThreads();
+    if (links != NULL)
+    {
+        threadLink(links->prev, links->next);
+    }
+}
+
+/**
+* Keeps the list in step with nodeSwap(), which trades the two nodes'
+* places in the tree. Neighbours have to be handled on their own since
+* then each node is the other's link.
+*/
+template <class Key, class Value>
+void BinarySearchTree<Key, Value>::threadSwap(Node<Key, Value>* n1, Node<Key, Value>* n2)
+{
+    ThreadLinks<Key, Value> *t1 = n1->getThreads();
+    ThreadLinks<Key, Value> *t2 = n2->getThreads();
+    if (t1 == NULL || t2 == NULL)
+    {
+        return;
+    }
+    Node<Key, Value> *prev1 = t1->prev;
+    Node<Key, Value> *next1 = t1->next;
+    Node<Key, Value> *prev2 = t2->prev;
+    Node<Key, Value> *next2 = t2->next;
+    if (next1 == n2)
+    {
+        threadLink(prev1, n2);
+        threadLink(n2, n1);
+        threadLink(n1, next2);
+    }
+    else if (next2 == n1)
+    {
+        threadLink(prev2, n1);
+        threadLink(n1, n2);
+        threadLink(n2, next1);
+    }
+    else
+    {
+        threadLink(prev1, n2);
+        threadLink(n2, next1);
+        threadLink(prev2, n1);
+        threadLink(n1, next2);
+    }
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+* Frees the nodes in one pass rather than removing the root n times,
+* which relinked (and for AVL, rebalanced) the tree after every removal.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::clear()
+{
+    deleteSubtree(root_);
+    root_ = nullptr;
+    leftmost_ = nullptr;
+    rightmost_ = nullptr;
+    size_ = 0;
+    maxSize_ = 0;
+}
+
+
+/**
+* A helper function to find the smallest node in the tree.
 */
 template<typename Key, typename Value>
 Node<Key, Value>*
 BinarySearchTree<Key, Value>::getSmallestNode() const
 {
     // TODO
-    // just like storing min -- always on left
-    Node<Key, Value> *smallest = root_;
-    Node<Key, Value> *iterate = root_;
+    // cached -- insert and removeNode keep it up to date
+    return leftmost_;
+}
 
-    // keep going to the left, where the smallest number exists
-    while (iterate != nullptr)
-    {
-        if (iterate->getLeft() != nullptr)
-        {
-            smallest = iterate;
-        }
-        iterate = iterate->getLeft();
-    }
-    // return smallest value
-    return smallest;
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::getLargestNode() const
+{
+    return rightmost_;
 }
 
 /**
@@ -752,16 +1961,31 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 {
     // TODO
     Node<Key, Value> *foundNode = root_;
+    // multimap mode: oldest match so far, keep looking left for an older one
+    Node<Key, Value> *firstMatch = nullptr;
     // same as searching through BST
     // nothing
     while (true) // or change to foundNode != nullptr
     {
         // either found the item or it is nullptr then return the key
-        if (foundNode == nullptr || foundNode->getKey() == key)
+        if (foundNode == nullptr)
+        {
+            return firstMatch;
+        }
+        this->countVisit();
+        this->countComparison();
+        if (foundNode->getKey() == key)
         {
-            return foundNode;
+            if (!multi_)
+            {
+                return foundNode;
+            }
+            firstMatch = foundNode;
+            foundNode = foundNode->getLeft();
+            continue;
         }
         // go to right if current is less than what you want to search for
+        this->countComparison();
         if (foundNode->getKey() < key)
         {
             foundNode = foundNode->getRight();
@@ -774,6 +1998,32 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
     }   
 }
 
+/**
+* Helper function to find the first node whose key is greater than k,
+* or NULL if there is none
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::upperBound(const Key& key) const
+{
+    Node<Key, Value> *bound = nullptr;
+    Node<Key, Value> *curr = root_;
+    while (curr != nullptr)
+    {
+        this->countVisit();
+        this->countComparison();
+        if (key < curr->getKey())
+        {
+            bound = curr;
+            curr = curr->getLeft();
+        }
+        else
+        {
+            curr = curr->getRight();
+        }
+    }
+    return bound;
+}
+
 /**
  * Return true iff the BST is balanced.
  */
@@ -785,6 +2035,12 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
     return isBalancedHelper(root_);
 }
 
+/**
+ * Post-order walk over the parent pointers instead of recursion, so a
+ * degenerate tree cannot overflow the call stack. Heights of finished
+ * subtrees wait on an explicit stack until their parent is finished,
+ * which makes the whole check O(n).
+ */
 template <typename Key, typename Value>
 bool BinarySearchTree<Key, Value>::isBalancedHelper(Node<Key, Value> *curr) const
 {
@@ -793,20 +2049,65 @@ bool BinarySearchTree<Key, Value>::isBalancedHelper(Node<Key, Value> *curr) cons
         return true;
     }
 
-    int leftH = getHeight(curr->getLeft());
-    int rightH = getHeight(curr->getRight());
-    int balanceFactor = rightH - leftH; // left - right
+    Node<Key, Value> *stop = curr->getParent();
+    Node<Key, Value> *prev = stop;
+    std::vector<int> heights;
 
-    if (abs(balanceFactor) <= 1 && isBalancedHelper(curr->getLeft()) && isBalancedHelper(curr->getRight()))
+    while (curr != stop)
     {
-        return true;
-    }
-    else
-    {
-        return false;
+        // first visit -- head down the left side, then the right
+        if (prev == curr->getParent())
+        {
+            prev = curr;
+            if (curr->getLeft() != nullptr)
+            {
+                curr = curr->getLeft();
+                continue;
+            }
+            if (curr->getRight() != nullptr)
+            {
+                curr = curr->getRight();
+                continue;
+            }
+        }
+        // back from the left side -- the right side is next
+        else if (prev == curr->getLeft() && curr->getRight() != nullptr)
+        {
+            prev = curr;
+            curr = curr->getRight();
+            continue;
+        }
+
+        // both sides are done, their heights are on top of the stack
+        int rightH = -1;
+        int leftH = -1;
+        if (curr->getRight() != nullptr)
+        {
+            rightH = heights.back();
+            heights.pop_back();
+        }
+        if (curr->getLeft() != nullptr)
+        {
+            leftH = heights.back();
+            heights.pop_back();
+        }
+        int balanceFactor = rightH - leftH; // left - right
+        if (abs(balanceFactor) > 1)
+        {
+            return false;
+        }
+        heights.push_back(1 + (leftH > rightH ? leftH : rightH));
+
+        prev = curr;
+        curr = curr->getParent();
     }
+    return true;
 }
 
+/**
+ * Walks the subtree over the parent pointers tracking the current depth,
+ * so it needs no recursion and no extra memory.
+ */
 template <typename Key, typename Value>
 int BinarySearchTree<Key, Value>::getHeight(Node<Key, Value> *temp) const
 {
@@ -814,25 +2115,60 @@ int BinarySearchTree<Key, Value>::getHeight(Node<Key, Value> *temp) const
     {
         return -1;
     }
-    // only root exists
-    if (temp->getLeft() == nullptr && temp->getRight() == nullptr)
-    {
-        return 0;
-    }
 
-    int leftHeight = getHeight(temp->getLeft());
-    int rightHeight = getHeight(temp->getRight());
+    Node<Key, Value> *stop = temp->getParent();
+    Node<Key, Value> *curr = temp;
+    Node<Key, Value> *prev = stop;
+    int depth = 0;
+    int height = 0;
 
-    // increment height everytime after recursion
-    if (leftHeight > rightHeight)
-    {
-        return leftHeight + 1;
-    }
-    else
+    while (curr != stop)
     {
-        return rightHeight + 1;
+        Node<Key, Value> *next;
+        // first visit -- go left, else right
+        if (prev == curr->getParent())
+        {
+            if (curr->getLeft() != nullptr)
+            {
+                next = curr->getLeft();
+            }
+            else if (curr->getRight() != nullptr)
+            {
+                next = curr->getRight();
+            }
+            else
+            {
+                next = curr->getParent();
+            }
+        }
+        // back from the left side
+        else if (prev == curr->getLeft() && curr->getRight() != nullptr)
+        {
+            next = curr->getRight();
+        }
+        // back from the right side (or the only side)
+        else
+        {
+            next = curr->getParent();
+        }
+
+        prev = curr;
+        if (next == curr->getParent())
+        {
+            depth--;
+        }
+        else
+        {
+            depth++;
+            // increment height everytime a new level is reached
+            if (depth > height)
+            {
+                height = depth;
+            }
+        }
+        curr = next;
     }
-    return 0;
+    return height;
 }
 
 template<typename Key, typename Value>
@@ -917,6 +2253,338 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
         this->root_ = n1;
     }
 
+    // the endpoints and (threaded mode) the in-order list follow the
+    // tree positions
+    if(leftmost_ == n1) leftmost_ = n2;
+    else if(leftmost_ == n2) leftmost_ = n1;
+    if(rightmost_ == n1) rightmost_ = n2;
+    else if(rightmost_ == n2) rightmost_ = n1;
+    threadSwap(n1, n2);
+}
+
+/**
+* Rebuilds the whole tree into a complete tree in O(n) time and O(1)
+* extra space (Day-Stout-Warren).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebalance()
+{
+    if (root_ != nullptr)
+    {
+        rebuildSubtree(root_);
+    }
+    maxSize_ = size_;
+}
+
+/**
+* Turns on scapegoat mode with the given alpha in [0.5, 1), or turns
+* it off when alpha is 0. Smaller alphas keep the tree shallower at
+* the cost of more frequent rebuilds.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setAutoRebalance(double alpha)
+{
+    if (alpha != 0.0 && (alpha < 0.5 || alpha >= 1.0))
+    {
+        throw std::invalid_argument("alpha must be 0 or in [0.5, 1)");
+    }
+    alpha_ = alpha;
+    maxSize_ = size_;
+}
+
+template<typename Key, typename Value>
+TreeStats BinarySearchTree<Key, Value>::stats() const
+{
+    return this->statsSnapshot();
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetStats()
+{
+    this->statsReset();
+}
+
+template<typename Key, typename Value>
+TreeLatency BinarySearchTree<Key, Value>::latency() const
+{
+    return this->latencySnapshot();
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetLatency()
+{
+    this->latencyReset();
+}
+
+/**
+* DSW on the subtree at subRoot: flatten it into a right-leaning vine
+* with right rotations, then fold the vine back up with rounds of left
+* rotations. Returns the new root of the subtree, which is reattached
+* to the old parent.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::rebuildSubtree(Node<Key, Value>* subRoot)
+{
+    if (subRoot == nullptr)
+    {
+        return nullptr;
+    }
+    Node<Key, Value> *parent = subRoot->getParent();
+    bool isLeft = (parent != nullptr && parent->getLeft() == subRoot);
+
+    // phase 1 -- tree to vine
+    Node<Key, Value> *head = nullptr;
+    Node<Key, Value> *tail = nullptr;
+    Node<Key, Value> *rest = subRoot;
+    size_t count = 0;
+    while (rest != nullptr)
+    {
+        if (rest->getLeft() == nullptr)
+        {
+            // already in vine order, move down
+            if (tail == nullptr)
+            {
+                head = rest;
+            }
+            tail = rest;
+            rest = rest->getRight();
+            count++;
+        }
+        else
+        {
+            // rotate right so the left child moves into the vine
+            Node<Key, Value> *leftChild = rest->getLeft();
+            rest->setLeft(leftChild->getRight());
+            if (leftChild->getRight() != nullptr)
+            {
+                leftChild->getRight()->setParent(rest);
+            }
+            leftChild->setRight(rest);
+            rest->setParent(leftChild);
+            if (tail != nullptr)
+            {
+                tail->setRight(leftChild);
+            }
+            leftChild->setParent(tail);
+            rest = leftChild;
+        }
+    }
+
+    // phase 2 -- vine to tree
+    // full = largest 2^k - 1 that fits, the leftovers fill the bottom level
+    size_t full = 1;
+    while (full * 2 + 1 <= count)
+    {
+        full = full * 2 + 1;
+    }
+    head = compressVine(head, count - full);
+    while (full > 1)
+    {
+        full /= 2;
+        head = compressVine(head, full);
+    }
+
+    head->setParent(parent);
+    if (parent == nullptr)
+    {
+        root_ = head;
+    }
+    else if (isLeft)
+    {
+        parent->setLeft(head);
+    }
+    else
+    {
+        parent->setRight(head);
+    }
+    return head;
+}
+
+/**
+* Left-rotates every other node along the right spine starting at head,
+* 'times' times. Returns the new head of the spine.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::compressVine(Node<Key, Value>* head, size_t times)
+{
+    // scanner == nullptr stands for the spot above head
+    Node<Key, Value> *scanner = nullptr;
+    for (size_t i = 0; i < times; i++)
+    {
+        Node<Key, Value> *child = (scanner == nullptr) ? head : scanner->getRight();
+        Node<Key, Value> *next = child->getRight();
+        if (scanner == nullptr)
+        {
+            head = next;
+        }
+        else
+        {
+            scanner->setRight(next);
+        }
+        next->setParent(scanner);
+        child->setRight(next->getLeft());
+        if (next->getLeft() != nullptr)
+        {
+            next->getLeft()->setParent(child);
+        }
+        next->setLeft(child);
+        child->setParent(next);
+        scanner = next;
+    }
+    return head;
+}
+
+/**
+* Counts the nodes under subRoot with an in-order walk over the parent
+* pointers, so it does not recurse.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::subtreeSize(Node<Key, Value>* subRoot)
+{
+    if (subRoot == nullptr)
+    {
+        return 0;
+    }
+    Node<Key, Value> *last = subRoot;
+    while (last->getRight() != nullptr)
+    {
+        last = last->getRight();
+    }
+    Node<Key, Value> *curr = subRoot;
+    while (curr->getLeft() != nullptr)
+    {
+        curr = curr->getLeft();
+    }
+    size_t count = 1;
+    while (curr != last)
+    {
+        curr = successor(curr);
+        count++;
+    }
+    return count;
+}
+
+/**
+* In-order construction: the left half is built first, then the middle
+* item is read, then the right half, so items are consumed in key order
+* and each is touched once. Halves differ by at most one node, so every
+* node's subtree heights do too. Anything built before an exception is
+* freed before it propagates.
+*/
+template<typename Key, typename Value>
+template<typename Source>
+Node<Key, Value>* BinarySearchTree<Key, Value>::buildSorted(size_t count, Source& source, Node<Key, Value>*& prev, int& height)
+{
+    if (count == 0)
+    {
+        height = 0;
+        return nullptr;
+    }
+    int leftHeight;
+    int rightHeight;
+    Node<Key, Value> *left = buildSorted(count / 2, source, prev, leftHeight);
+    Node<Key, Value> *node;
+    try
+    {
+        Key key;
+        Value value;
+        source(key, value);
+        if (prev != nullptr && (key < prev->getKey() || (!multi_ && !(prev->getKey() < key))))
+        {
+            throw std::invalid_argument("Items are out of key order");
+        }
+        node = createNode(key, value, nullptr);
+    }
+    catch (...)
+    {
+        deleteSubtree(left);
+        throw;
+    }
+    node->setLeft(left);
+    if (left != nullptr)
+    {
+        left->setParent(node);
+    }
+    if (threaded_ && prev != nullptr)
+    {
+        threadLink(prev, node);
+    }
+    prev = node;
+
+    Node<Key, Value> *right;
+    try
+    {
+        right = buildSorted(count - count / 2 - 1, source, prev, rightHeight);
+    }
+    catch (...)
+    {
+        deleteSubtree(node);
+        throw;
+    }
+    node->setRight(right);
+    if (right != nullptr)
+    {
+        right->setParent(node);
+    }
+    builtNode(node, leftHeight, rightHeight);
+    height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    return node;
+}
+
+template<typename Key, typename Value>
+template<typename Source>
+void BinarySearchTree<Key, Value>::buildFrom(size_t count, Source& source)
+{
+    clear();
+    Node<Key, Value> *prev = nullptr;
+    int height;
+    Node<Key, Value> *root = buildSorted(count, source, prev, height);
+    adoptBuilt(root, count, prev);
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::adoptBuilt(Node<Key, Value>* root, size_t count, Node<Key, Value>* last)
+{
+    root_ = root;
+    size_ = count;
+    maxSize_ = size_;
+    leftmost_ = root_;
+    while (leftmost_ != nullptr && leftmost_->getLeft() != nullptr)
+    {
+        leftmost_ = leftmost_->getLeft();
+    }
+    rightmost_ = last;
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::builtNode(Node<Key, Value>*, int, int)
+{
+}
+
+/**
+* Right-rotates left children away as it goes, so the walk needs
+* neither a stack nor parent pointers.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::deleteSubtree(Node<Key, Value>* subRoot)
+{
+    Node<Key, Value> *curr = subRoot;
+    while (curr != nullptr)
+    {
+        Node<Key, Value> *left = curr->getLeft();
+        if (left != nullptr)
+        {
+            curr->setLeft(left->getRight());
+            left->setRight(curr);
+            curr = left;
+        }
+        else
+        {
+            Node<Key, Value> *right = curr->getRight();
+            delete curr;
+            curr = right;
+        }
+    }
 }
 
 /**
@@ -0,0 +1,401 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include "avl_algorithms.h"
+
+/**
+ * A node for CompactAVLTree. Nodes live in a pool and point at each other
+ * with 32-bit indices instead of 64-bit pointers, and there is no vtable.
+ * The balance is not stored here at all -- it is packed 4 to a byte in a
+ * side array -- so for uint32_t keys and values a node is 20 bytes against
+ * the 48 (plus allocator overhead) of an AVLNode<uint32_t, uint32_t>.
+ */
+template <typename Key, typename Value>
+struct CompactAVLNode
+{
+    std::pair<Key, Value> item;
+    uint32_t parent;
+    uint32_t left;
+    uint32_t right;
+};
+
+/**
+ * An AVL map whose nodes sit in a growable pool of fixed-size chunks and
+ * link with 32-bit indices, for up to 2^32 - 1 nodes. Chunks never move,
+ * so growing the pool does not copy nodes, and removed slots are reused
+ * through a free list.
+ *
+ * insert() overwrites existing keys like AVLTree. Items are read through
+ * the iterator and written through operator[] or insert().
+ */
+template <typename Key, typename Value>
+class CompactAVLTree
+{
+public:
+    typedef CompactAVLNode<Key, Value> CNode;
+    // index meaning "no node"
+    static const uint32_t NIL = 0xFFFFFFFFu;
+
+    CompactAVLTree();
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    void remove(const Key &key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    // bytes held by the node pool and the balance bits
+    size_t memoryBytes() const;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<Key, Value> &operator*() const;
+        const std::pair<Key, Value> *operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        iterator(const CompactAVLTree *tree, uint32_t index);
+        const CompactAVLTree *tree_;
+        uint32_t current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+    Value &operator[](const Key &key);
+    Value const &operator[](const Key &key) const;
+
+protected:
+    // 2^16 nodes per chunk
+    static const unsigned CHUNK_BITS = 16;
+    static const uint32_t CHUNK_MASK = (1u << CHUNK_BITS) - 1;
+
+    CNode &node(uint32_t i);
+    const CNode &node(uint32_t i) const;
+    int getBalance(uint32_t i) const;
+    void setBalance(uint32_t i, int balance);
+    uint32_t allocate(const Key &key, const Value &value);
+    void release(uint32_t i);
+    uint32_t internalFind(const Key &key) const;
+
+    // link access for AVLAlgorithms
+    struct Ops
+    {
+        typedef uint32_t Handle;
+        CompactAVLTree *tree_;
+
+        explicit Ops(CompactAVLTree *tree) : tree_(tree) {}
+
+        Handle nil() const { return NIL; }
+        Handle parent(Handle n) const { return tree_->node(n).parent; }
+        Handle left(Handle n) const { return tree_->node(n).left; }
+        Handle right(Handle n) const { return tree_->node(n).right; }
+        int balance(Handle n) const { return tree_->getBalance(n); }
+        void setParent(Handle n, Handle p) { tree_->node(n).parent = p; }
+        void setLeft(Handle n, Handle l) { tree_->node(n).left = l; }
+        void setRight(Handle n, Handle r) { tree_->node(n).right = r; }
+        void setBalance(Handle n, int b) { tree_->setBalance(n, b); }
+        Handle root() const { return tree_->root_; }
+        void setRoot(Handle r) { tree_->root_ = r; }
+        void rotated(Handle) {}
+        void fixStep() {}
+    };
+    typedef AVLAlgorithms<Ops> Algo;
+
+    std::vector<std::vector<CNode> > chunks_;
+    // balance + 1 in two bits per node, four nodes per byte
+    std::vector<uint8_t> balances_;
+    uint32_t root_;
+    uint32_t used_;     // slots handed out so far (live or freed)
+    uint32_t freeHead_; // freed slots, chained through left
+    size_t size_;
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the CompactAVLTree::iterator class.
+--------------------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+CompactAVLTree<Key, Value>::iterator::iterator() : tree_(nullptr), current_(NIL)
+{
+}
+
+template <typename Key, typename Value>
+CompactAVLTree<Key, Value>::iterator::iterator(const CompactAVLTree *tree, uint32_t index) : tree_(tree), current_(index)
+{
+}
+
+template <typename Key, typename Value>
+const std::pair<Key, Value> &CompactAVLTree<Key, Value>::iterator::operator*() const
+{
+    return tree_->node(current_).item;
+}
+
+template <typename Key, typename Value>
+const std::pair<Key, Value> *CompactAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(tree_->node(current_).item);
+}
+
+template <typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::iterator::operator==(const iterator &rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template <typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::iterator::operator!=(const iterator &rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template <typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator &CompactAVLTree<Key, Value>::iterator::operator++()
+{
+    current_ = Algo::successor(Ops(const_cast<CompactAVLTree *>(tree_)), current_);
+    return *this;
+}
+
+/*
+---------------------------------------------------
+Begin implementations for the CompactAVLTree class.
+---------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+CompactAVLTree<Key, Value>::CompactAVLTree() : root_(NIL), used_(0), freeHead_(NIL), size_(0)
+{
+}
+
+template <typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::CNode &CompactAVLTree<Key, Value>::node(uint32_t i)
+{
+    return chunks_[i >> CHUNK_BITS][i & CHUNK_MASK];
+}
+
+template <typename Key, typename Value>
+const typename CompactAVLTree<Key, Value>::CNode &CompactAVLTree<Key, Value>::node(uint32_t i) const
+{
+    return chunks_[i >> CHUNK_BITS][i & CHUNK_MASK];
+}
+
+template <typename Key, typename Value>
+int CompactAVLTree<Key, Value>::getBalance(uint32_t i) const
+{
+    return ((balances_[i >> 2] >> ((i & 3) * 2)) & 3) - 1;
+}
+
+template <typename Key, typename Value>
+void CompactAVLTree<Key, Value>::setBalance(uint32_t i, int balance)
+{
+    unsigned shift = (i & 3) * 2;
+    uint8_t &byte = balances_[i >> 2];
+    byte = (uint8_t)((byte & ~(3u << shift)) | ((unsigned)(balance + 1) << shift));
+}
+
+/**
+ * Hands out a slot, preferring freed ones, growing the pool a chunk at a
+ * time when needed.
+ */
+template <typename Key, typename Value>
+uint32_t CompactAVLTree<Key, Value>::allocate(const Key &key, const Value &value)
+{
+    uint32_t i;
+    if (freeHead_ != NIL)
+    {
+        i = freeHead_;
+        freeHead_ = node(i).left;
+        node(i).item.first = key;
+        node(i).item.second = value;
+        return i;
+    }
+    if (used_ == NIL)
+    {
+        throw std::length_error("CompactAVLTree is full");
+    }
+    i = used_++;
+    if ((i & CHUNK_MASK) == 0)
+    {
+        chunks_.push_back(std::vector<CNode>());
+        chunks_.back().reserve((size_t)CHUNK_MASK + 1);
+    }
+    CNode fresh;
+    fresh.item = std::pair<Key, Value>(key, value);
+    fresh.parent = fresh.left = fresh.right = NIL;
+    chunks_.back().push_back(fresh);
+    if ((i & 3) == 0)
+    {
+        balances_.push_back(0);
+    }
+    return i;
+}
+
+template <typename Key, typename Value>
+void CompactAVLTree<Key, Value>::release(uint32_t i)
+{
+    node(i).left = freeHead_;
+    freeHead_ = i;
+}
+
+template <typename Key, typename Value>
+bool CompactAVLTree<Key, Value>::empty() const
+{
+    return root_ == NIL;
+}
+
+template <typename Key, typename Value>
+size_t CompactAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value>
+size_t CompactAVLTree<Key, Value>::memoryBytes() const
+{
+    size_t total = chunks_.capacity() * sizeof(std::vector<CNode>) + balances_.capacity();
+    for (size_t c = 0; c < chunks_.size(); c++)
+    {
+        total += chunks_[c].capacity() * sizeof(CNode);
+    }
+    return total;
+}
+
+/**
+ * Inserts the pair, or overwrites the value if the key is already there.
+ */
+template <typename Key, typename Value>
+void CompactAVLTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    uint32_t parent = NIL;
+    uint32_t curr = root_;
+    bool asLeft = false;
+    while (curr != NIL)
+    {
+        CNode &n = node(curr);
+        parent = curr;
+        if (keyValuePair.first < n.item.first)
+        {
+            asLeft = true;
+            curr = n.left;
+        }
+        else if (n.item.first < keyValuePair.first)
+        {
+            asLeft = false;
+            curr = n.right;
+        }
+        else
+        {
+            n.item.second = keyValuePair.second;
+            return;
+        }
+    }
+    uint32_t fresh = allocate(keyValuePair.first, keyValuePair.second);
+    Ops ops(this);
+    Algo::insertAt(ops, parent, asLeft, fresh);
+    size_++;
+}
+
+template <typename Key, typename Value>
+void CompactAVLTree<Key, Value>::remove(const Key &key)
+{
+    uint32_t i = internalFind(key);
+    if (i == NIL)
+    {
+        return;
+    }
+    Ops ops(this);
+    Algo::erase(ops, i);
+    release(i);
+    size_--;
+}
+
+/**
+ * Drops the whole pool at once -- no per-node work beyond destructors.
+ */
+template <typename Key, typename Value>
+void CompactAVLTree<Key, Value>::clear()
+{
+    std::vector<std::vector<CNode> >().swap(chunks_);
+    std::vector<uint8_t>().swap(balances_);
+    root_ = NIL;
+    used_ = 0;
+    freeHead_ = NIL;
+    size_ = 0;
+}
+
+template <typename Key, typename Value>
+uint32_t CompactAVLTree<Key, Value>::internalFind(const Key &key) const
+{
+    uint32_t curr = root_;
+    while (curr != NIL)
+    {
+        const CNode &n = node(curr);
+        if (key < n.item.first)
+        {
+            curr = n.left;
+        }
+        else if (n.item.first < key)
+        {
+            curr = n.right;
+        }
+        else
+        {
+            return curr;
+        }
+    }
+    return NIL;
+}
+
+template <typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::begin() const
+{
+    return iterator(this, Algo::leftmost(Ops(const_cast<CompactAVLTree *>(this)), root_));
+}
+
+template <typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::end() const
+{
+    return iterator(this, NIL);
+}
+
+template <typename Key, typename Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::find(const Key &key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <typename Key, typename Value>
+Value &CompactAVLTree<Key, Value>::operator[](const Key &key)
+{
+    uint32_t i = internalFind(key);
+    if (i == NIL) throw std::out_of_range("Invalid key");
+    return node(i).item.second;
+}
+
+template <typename Key, typename Value>
+Value const &CompactAVLTree<Key, Value>::operator[](const Key &key) const
+{
+    uint32_t i = internalFind(key);
+    if (i == NIL) throw std::out_of_range("Invalid key");
+    return node(i).item.second;
+}
+
+#endif
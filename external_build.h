@@ -0,0 +1,527 @@
+#ifndef EXTERNAL_BUILD_H
+#define EXTERNAL_BUILD_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include "snapshot.h"
+#include "mapped_avl.h"
+
+/**
+ * Builds a tree from more items than fit in memory, arriving in any
+ * order. add() collects items until the memory budget is full, then sorts
+ * them and spills them to a run file; build() and writeImage() k-way
+ * merge the runs straight into the linear-time balanced build of a tree
+ * or of a MappedAVLTree image, so the sorted whole is never written out.
+ * If every item fits in one chunk no file is written at all.
+ *
+ * The budget counts sizeof(std::pair<Key, Value>) per buffered item,
+ * twice over for the sort's scratch space. Memory a key or value owns (a
+ * long std::string, say), the tree being built and the 1 MiB buffer of
+ * the run being written come on top. The merge splits the budget into
+ * read buffers, one per run.
+ *
+ * In map mode (the default) the item added last for a key wins, as if
+ * each had been inserted in turn; with keepDuplicates every item comes
+ * out, in the order added among equal keys. Runs are written with the
+ * codecs to files under tempDir, removed when the sorter is destroyed.
+ */
+template <typename Key, typename Value, typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+class ExternalSorter
+{
+public:
+    typedef std::pair<Key, Value> Item;
+
+    // throws std::invalid_argument for a budget too small for one item
+    ExternalSorter(size_t memoryBytes, const std::string &tempDir = ".", bool keepDuplicates = false);
+    ~ExternalSorter();
+
+    void add(const Key &key, const Value &value);
+    // adds every record of path, each a key and a value written by the
+    // codecs back to back, with no header; std::runtime_error if the
+    // last one is cut short
+    void addFile(const std::string &path);
+
+    size_t added() const;
+    // run files spilled so far
+    size_t runs() const;
+
+    // replace tree's contents with the sorted items, through
+    // assignSorted() or MappedAVLTree::write(). Both can be repeated, and
+    // more items added in between.
+    template <typename Tree>
+    void build(Tree &tree);
+    void writeImage(const std::string &path);
+
+protected:
+    struct KeyLess
+    {
+        bool operator()(const Item &a, const Item &b) const;
+    };
+
+    // the next unread item of one run
+    struct RunSource
+    {
+        SnapshotReader *in;
+        uint64_t left;
+        size_t run;
+        Item item;
+        bool next();
+    };
+
+    // heap order on run indices: smallest key first, and among equal
+    // keys the earlier run, so the last one popped is the newest
+    struct HeadAfter
+    {
+        const std::vector<RunSource> *sources;
+        bool operator()(size_t a, size_t b) const;
+    };
+
+    /**
+     * One pass over the sorted items, from the buffer when nothing was
+     * spilled and from the runs otherwise.
+     */
+    class Merge
+    {
+    public:
+        explicit Merge(ExternalSorter &sorter);
+        ~Merge();
+
+        bool has() const;
+        const Item &item() const;
+        void next();
+
+    protected:
+        void advance(size_t source);
+
+        ExternalSorter &sorter_;
+        std::vector<SnapshotReader *> readers_;
+        std::vector<RunSource> sources_;
+        std::priority_queue<size_t, std::vector<size_t>, HeadAfter> heads_;
+        size_t pos_;
+        const Item *current_;
+        Item merged_;
+
+    private:
+        Merge(const Merge &);
+        Merge &operator=(const Merge &);
+    };
+
+    // what the tree builders read from: ->first, ->second and ++
+    class MergeIterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Item value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Item *pointer;
+        typedef const Item &reference;
+
+        explicit MergeIterator(Merge *merge);
+
+        const Item &operator*() const;
+        const Item *operator->() const;
+        MergeIterator &operator++();
+
+    protected:
+        Merge *merge_;
+    };
+
+    // readies the items for a merge: sorted in place if nothing has been
+    // spilled, else the rest spilled as one more run
+    void finish();
+    void spill();
+    // stable sort by key, then in map mode only the last of equal keys stays
+    void sortBuffer();
+    // how many items a merge will produce; in map mode with several runs
+    // this takes a pass over them, as a key may be in more than one
+    size_t sortedCount();
+
+    std::string tempDir_;
+    bool keepDuplicates_;
+    size_t memoryBytes_;
+    size_t capacity_;
+    size_t added_;
+    std::vector<Item> buffer_;
+    std::vector<std::string> runPaths_;
+    std::vector<uint64_t> runCounts_;
+
+private:
+    ExternalSorter(const ExternalSorter &);
+    ExternalSorter &operator=(const ExternalSorter &);
+};
+
+// smallest read buffer a merge gives each run, however many there are
+static const size_t EXTERNAL_MIN_READ_BYTES = 64 << 10;
+
+/*
+-------------------------------------------------------
+Begin implementations for the ExternalSorter helpers.
+-------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+bool ExternalSorter<Key, Value, KeyCodec, ValueCodec>::KeyLess::operator()(const Item &a, const Item &b) const
+{
+    return a.first < b.first;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+bool ExternalSorter<Key, Value, KeyCodec, ValueCodec>::RunSource::next()
+{
+    if (left == 0)
+    {
+        return false;
+    }
+    left--;
+    KeyCodec::read(*in, item.first);
+    ValueCodec::read(*in, item.second);
+    return true;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+bool ExternalSorter<Key, Value, KeyCodec, ValueCodec>::HeadAfter::operator()(size_t a, size_t b) const
+{
+    const Key &keyA = (*sources)[a].item.first;
+    const Key &keyB = (*sources)[b].item.first;
+    return keyB < keyA || (!(keyA < keyB) && (*sources)[a].run > (*sources)[b].run);
+}
+
+/**
+ * Opens every run with an equal share of the budget to buffer it, and
+ * reads the first item of each.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Merge::Merge(ExternalSorter &sorter)
+    : sorter_(sorter), sources_(sorter.runPaths_.size()), pos_(0), current_(nullptr)
+{
+    HeadAfter order;
+    order.sources = &sources_;
+    heads_ = std::priority_queue<size_t, std::vector<size_t>, HeadAfter>(order);
+    if (sources_.empty())
+    {
+        if (!sorter_.buffer_.empty())
+        {
+            current_ = &sorter_.buffer_[0];
+        }
+        return;
+    }
+
+    size_t readBytes = sorter_.memoryBytes_ / sources_.size();
+    readBytes = std::min(std::max(readBytes, EXTERNAL_MIN_READ_BYTES), SNAPSHOT_BUFFER_BYTES);
+    try
+    {
+        for (size_t i = 0; i < sources_.size(); i++)
+        {
+            readers_.push_back(new SnapshotReader(sorter_.runPaths_[i], readBytes));
+            sources_[i].in = readers_.back();
+            sources_[i].left = sorter_.runCounts_[i];
+            sources_[i].run = i;
+            advance(i);
+        }
+    }
+    catch (...)
+    {
+        for (size_t i = 0; i < readers_.size(); i++)
+        {
+            delete readers_[i];
+        }
+        throw;
+    }
+    next();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Merge::~Merge()
+{
+    for (size_t i = 0; i < readers_.size(); i++)
+    {
+        delete readers_[i];
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+bool ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Merge::has() const
+{
+    return current_ != nullptr;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+const typename ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Item &
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Merge::item() const
+{
+    return *current_;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Merge::advance(size_t source)
+{
+    if (sources_[source].next())
+    {
+        heads_.push(source);
+    }
+}
+
+/**
+ * Takes the smallest head. In map mode every other head with the same key
+ * follows straight after it, each newer than the last, so its value
+ * replaces the one taken.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Merge::next()
+{
+    if (sources_.empty())
+    {
+        pos_++;
+        current_ = (pos_ < sorter_.buffer_.size()) ? &sorter_.buffer_[pos_] : nullptr;
+        return;
+    }
+    if (heads_.empty())
+    {
+        current_ = nullptr;
+        return;
+    }
+    size_t top = heads_.top();
+    heads_.pop();
+    merged_ = sources_[top].item;
+    advance(top);
+    while (!sorter_.keepDuplicates_ && !heads_.empty() && !(merged_.first < sources_[heads_.top()].item.first))
+    {
+        top = heads_.top();
+        heads_.pop();
+        merged_.second = sources_[top].item.second;
+        advance(top);
+    }
+    current_ = &merged_;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::MergeIterator::MergeIterator(Merge *merge) : merge_(merge)
+{
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+const typename ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Item &
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::MergeIterator::operator*() const
+{
+    return merge_->item();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+const typename ExternalSorter<Key, Value, KeyCodec, ValueCodec>::Item *
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::MergeIterator::operator->() const
+{
+    return &(merge_->item());
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+typename ExternalSorter<Key, Value, KeyCodec, ValueCodec>::MergeIterator &
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::MergeIterator::operator++()
+{
+    merge_->next();
+    return *this;
+}
+
+/*
+----------------------------------------------------
+Begin implementations for the ExternalSorter class.
+----------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::ExternalSorter(size_t memoryBytes, const std::string &tempDir, bool keepDuplicates)
+    : tempDir_(tempDir), keepDuplicates_(keepDuplicates), memoryBytes_(memoryBytes), added_(0)
+{
+    // half for the items, half for std::stable_sort's buffer
+    capacity_ = memoryBytes / (2 * sizeof(Item));
+    if (capacity_ == 0)
+    {
+        throw std::invalid_argument("memoryBytes must hold at least one item");
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+ExternalSorter<Key, Value, KeyCodec, ValueCodec>::~ExternalSorter()
+{
+    for (size_t i = 0; i < runPaths_.size(); i++)
+    {
+        std::remove(runPaths_[i].c_str());
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::add(const Key &key, const Value &value)
+{
+    if (buffer_.size() == capacity_)
+    {
+        spill();
+    }
+    if (buffer_.capacity() == 0)
+    {
+        // one allocation of the whole chunk, rather than doubling up to it
+        buffer_.reserve(capacity_);
+    }
+    buffer_.push_back(Item(key, value));
+    added_++;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::addFile(const std::string &path)
+{
+    SnapshotReader in(path);
+    Key key;
+    Value value;
+    while (!in.atEnd())
+    {
+        KeyCodec::read(in, key);
+        ValueCodec::read(in, value);
+        add(key, value);
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t ExternalSorter<Key, Value, KeyCodec, ValueCodec>::added() const
+{
+    return added_;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t ExternalSorter<Key, Value, KeyCodec, ValueCodec>::runs() const
+{
+    return runPaths_.size();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::sortBuffer()
+{
+    std::stable_sort(buffer_.begin(), buffer_.end(), KeyLess());
+    if (keepDuplicates_)
+    {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < buffer_.size(); i++)
+    {
+        if (kept > 0 && !(buffer_[kept - 1].first < buffer_[i].first))
+        {
+            buffer_[kept - 1].second = buffer_[i].second;
+        }
+        else
+        {
+            if (kept != i)
+            {
+                buffer_[kept] = buffer_[i];
+            }
+            kept++;
+        }
+    }
+    buffer_.erase(buffer_.begin() + kept, buffer_.end());
+}
+
+/**
+ * Runs are numbered in the order they are spilled, which is what lets the
+ * merge tell the newer of two equal keys.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::spill()
+{
+    sortBuffer();
+    std::string pattern = tempDir_ + "/bst-run-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    int fd = ::mkstemp(&name[0]);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create a run file in " + tempDir_);
+    }
+    ::close(fd);
+    std::string path(&name[0]);
+    try
+    {
+        SnapshotWriter out(path);
+        for (size_t i = 0; i < buffer_.size(); i++)
+        {
+            KeyCodec::write(out, buffer_[i].first);
+            ValueCodec::write(out, buffer_[i].second);
+        }
+        out.close();
+    }
+    catch (...)
+    {
+        std::remove(path.c_str());
+        throw;
+    }
+    runPaths_.push_back(path);
+    runCounts_.push_back(buffer_.size());
+    buffer_.clear();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::finish()
+{
+    if (runPaths_.empty())
+    {
+        sortBuffer();
+    }
+    else if (!buffer_.empty())
+    {
+        spill();
+    }
+    if (!runPaths_.empty())
+    {
+        // hand the chunk's memory over to the merge's read buffers
+        std::vector<Item>().swap(buffer_);
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t ExternalSorter<Key, Value, KeyCodec, ValueCodec>::sortedCount()
+{
+    if (runPaths_.empty())
+    {
+        return buffer_.size();
+    }
+    size_t count = 0;
+    if (keepDuplicates_ || runPaths_.size() == 1)
+    {
+        for (size_t i = 0; i < runCounts_.size(); i++)
+        {
+            count += (size_t)runCounts_[i];
+        }
+        return count;
+    }
+    for (Merge merge(*this); merge.has(); merge.next())
+    {
+        count++;
+    }
+    return count;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+template <typename Tree>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::build(Tree &tree)
+{
+    finish();
+    size_t count = sortedCount();
+    Merge merge(*this);
+    tree.assignSorted(MergeIterator(&merge), count);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void ExternalSorter<Key, Value, KeyCodec, ValueCodec>::writeImage(const std::string &path)
+{
+    finish();
+    size_t count = sortedCount();
+    Merge merge(*this);
+    MappedAVLTree<Key, Value>::write(path, MergeIterator(&merge), count);
+}
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef INTERVAL_TREE_H
+#define INTERVAL_TREE_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include "augmented_avl.h"
+
+/**
+ * A closed interval [lo, hi], ordered by lo and then hi.
+ */
+template <typename T>
+struct Interval
+{
+    T lo;
+    T hi;
+    Interval() : lo(), hi() {}
+    Interval(const T &l, const T &h) : lo(l), hi(h) {}
+};
+
+template <typename T>
+bool operator<(const Interval<T> &a, const Interval<T> &b)
+{
+    return a.lo < b.lo || (!(b.lo < a.lo) && a.hi < b.hi);
+}
+
+template <typename T>
+bool operator==(const Interval<T> &a, const Interval<T> &b)
+{
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+// so the tree can still print()
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Interval<T> &interval)
+{
+    return os << '[' << interval.lo << ',' << interval.hi << ']';
+}
+
+/**
+ * Monoid for IntervalTree: the largest right endpoint in a subtree.
+ */
+template <typename T>
+struct MaxEndMonoid
+{
+    typedef T result_type;
+    T identity() const { return std::numeric_limits<T>::lowest(); }
+    T combine(const T &a, const T &b) const { return std::max(a, b); }
+    template <typename Value>
+    T lift(const Interval<T> &interval, const Value &) const { return interval.hi; }
+};
+
+/**
+ * An interval tree over closed intervals [lo, hi]. Intervals are the keys,
+ * so the AVL order is by left endpoint, and each node carries the maximum
+ * right endpoint of its subtree -- kept through the AVL rotations by
+ * AugmentedAVLTree. Any subtree whose maximum end lies left of a query can
+ * be skipped whole.
+ */
+template <typename T, typename Value>
+class IntervalTree : public AugmentedAVLTree<Interval<T>, Value, MaxEndMonoid<T> >
+{
+public:
+    typedef AugmentedAVLTree<Interval<T>, Value, MaxEndMonoid<T> > Base;
+    typedef typename Base::AugNode AugNode;
+    typedef typename BinarySearchTree<Interval<T>, Value>::iterator iterator;
+
+    virtual void insert(const std::pair<const Interval<T>, Value> &new_item);
+    void insert(const T &lo, const T &hi, const Value &value);
+    using Base::insert;
+
+    // every interval that intersects [lo, hi], in key order -- O(min(n,
+    // (k + 1) log n)) for k results
+    void overlapping(const T &lo, const T &hi, std::vector<iterator> &out) const;
+    // every interval that contains point
+    void stab(const T &point, std::vector<iterator> &out) const;
+    // out[i] gets every interval containing points[i], from one sorted sweep
+    void stab_many(const std::vector<T> &points, std::vector<std::vector<iterator> > &out) const;
+};
+
+template <typename T, typename Value>
+void IntervalTree<T, Value>::insert(const std::pair<const Interval<T>, Value> &new_item)
+{
+    if (new_item.first.hi < new_item.first.lo)
+    {
+        throw std::invalid_argument("Interval end before its start");
+    }
+    Base::insert(new_item);
+}
+
+template <typename T, typename Value>
+void IntervalTree<T, Value>::insert(const T &lo, const T &hi, const Value &value)
+{
+    insert(std::pair<const Interval<T>, Value>(Interval<T>(lo, hi), value));
+}
+
+/**
+ * In-order walk with an explicit stack that never descends into a subtree
+ * ending before lo, and stops at the first interval starting after hi.
+ * Every node visited is on the path to a result or to that stopping
+ * interval, so the walk is at most (k + 1) root-to-leaf paths. Intervals
+ * between two results that end before lo are skipped, but each can cost
+ * a path of its own.
+ */
+template <typename T, typename Value>
+void IntervalTree<T, Value>::overlapping(const T &lo, const T &hi, std::vector<iterator> &out) const
+{
+    out.clear();
+    std::vector<AugNode *> path;
+    AugNode *curr = static_cast<AugNode *>(this->root_);
+    while (true)
+    {
+        // go left as far as the subtree can still reach lo
+        while (curr != nullptr && !(curr->getAggregate() < lo))
+        {
+            path.push_back(curr);
+            curr = curr->getLeft();
+        }
+        if (path.empty())
+        {
+            return;
+        }
+        curr = path.back();
+        path.pop_back();
+        // keys are in start order, so nothing later can start by hi
+        if (hi < curr->getKey().lo)
+        {
+            return;
+        }
+        if (!(curr->getKey().hi < lo))
+        {
+            out.push_back(this->makeIterator(curr));
+        }
+        curr = curr->getRight();
+    }
+}
+
+template <typename T, typename Value>
+void IntervalTree<T, Value>::stab(const T &point, std::vector<iterator> &out) const
+{
+    overlapping(point, point, out);
+}
+
+namespace interval_tree_detail
+{
+// min-heap order on the right endpoint
+template <typename T, typename Iter>
+struct EndsLater
+{
+    bool operator()(const std::pair<T, Iter> &a, const std::pair<T, Iter> &b) const
+    {
+        return b.first < a.first;
+    }
+};
+
+// sorts point indices by point
+template <typename T>
+struct PointLess
+{
+    const std::vector<T> *points;
+    bool operator()(size_t a, size_t b) const
+    {
+        return (*points)[a] < (*points)[b];
+    }
+};
+}
+
+/**
+ * Sweeps the sorted points and the intervals (already sorted by start) in
+ * one pass. Intervals join an active min-heap on their end as soon as they
+ * start, and drop out once a point passes their end, so each point reports
+ * exactly the active set. For m points, n intervals (those starting after
+ * the last point are never reached) and at most a of them active at once,
+ * that is O(m log m) to sort the points, O(n log a) to sweep, and the
+ * size of the output -- O(n + m log m + output) when few intervals
+ * overlap, however the points cluster.
+ */
+template <typename T, typename Value>
+void IntervalTree<T, Value>::stab_many(const std::vector<T> &points, std::vector<std::vector<iterator> > &out) const
+{
+    out.assign(points.size(), std::vector<iterator>());
+
+    std::vector<size_t> order(points.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    interval_tree_detail::PointLess<T> byPoint;
+    byPoint.points = &points;
+    std::sort(order.begin(), order.end(), byPoint);
+
+    typedef std::pair<T, iterator> Active;
+    interval_tree_detail::EndsLater<T, iterator> endsLater;
+    std::vector<Active> active;
+    iterator next = this->begin();
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const T &point = points[order[i]];
+        // admit every interval that has started
+        while (next != this->end() && !(point < next->first.lo))
+        {
+            active.push_back(Active(next->first.hi, next));
+            std::push_heap(active.begin(), active.end(), endsLater);
+            ++next;
+        }
+        // retire every interval that has ended
+        while (!active.empty() && active.front().first < point)
+        {
+            std::pop_heap(active.begin(), active.end(), endsLater);
+            active.pop_back();
+        }
+        std::vector<iterator> &hits = out[order[i]];
+        hits.reserve(active.size());
+        for (size_t j = 0; j < active.size(); j++)
+        {
+            hits.push_back(active[j].second);
+        }
+    }
+}
+
+#endif
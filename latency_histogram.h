@@ -0,0 +1,223 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define LATENCY_RDTSC 1
+#endif
+
+// Each power of two is split into 2^LATENCY_SUB_BITS buckets, so a
+// recorded value is known to within 1/16 (6.25%)
+static const int LATENCY_SUB_BITS = 4;
+// values of 2^LATENCY_MAX_EXPONENT ticks (minutes) and up share the last
+// bucket
+static const int LATENCY_MAX_EXPONENT = 40;
+// one bucket per value below 2^LATENCY_SUB_BITS, then 2^LATENCY_SUB_BITS
+// per power of two up to LATENCY_MAX_EXPONENT
+static const int LATENCY_BUCKETS = (LATENCY_MAX_EXPONENT - LATENCY_SUB_BITS + 2) << LATENCY_SUB_BITS;
+
+/**
+ * A cheap timestamp: the CPU's time-stamp counter where there is one
+ * (about 20 cycles to read, and not serialising, so an interval can be
+ * off by a few tens of cycles), steady_clock nanoseconds elsewhere.
+ */
+inline uint64_t latencyTicks()
+{
+#ifdef LATENCY_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * Ticks per nanosecond, measured once against steady_clock over 10 ms
+ * (the first call pays for it). Assumes a constant-rate counter, which
+ * every x86 CPU of the last decade has.
+ */
+inline double latencyTicksPerNs()
+{
+#ifdef LATENCY_RDTSC
+    struct Calibration
+    {
+        static double measure()
+        {
+            typedef std::chrono::steady_clock Clock;
+            Clock::time_point start = Clock::now();
+            uint64_t first = latencyTicks();
+            double ns = 0;
+            while (ns < 1e7)
+            {
+                ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            }
+            return (double)(latencyTicks() - first) / ns;
+        }
+    };
+    static const double ratio = Calibration::measure();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+/**
+ * Count, mean and tail of one histogram, in nanoseconds.
+ */
+struct LatencySummary
+{
+    uint64_t count;
+    double meanNs;
+    double p50Ns;
+    double p99Ns;
+    double p999Ns;
+    double maxNs;
+
+    LatencySummary() : count(0), meanNs(0), p50Ns(0), p99Ns(0), p999Ns(0), maxNs(0) {}
+};
+
+/**
+ * Log-bucketed histogram of tick counts in the style of HdrHistogram:
+ * fixed size, O(1) record with no allocation, and percentiles read back
+ * to within the bucket width. Values below 2^LATENCY_SUB_BITS get a
+ * bucket each.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    void record(uint64_t ticks)
+    {
+        counts_[bucketOf(ticks)]++;
+        count_++;
+        sum_ += ticks;
+        if (ticks > max_)
+        {
+            max_ = ticks;
+        }
+    }
+
+    void reset()
+    {
+        std::fill(counts_, counts_ + LATENCY_BUCKETS, (uint64_t)0);
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    // adds in another histogram's values, e.g. to combine several trees
+    void merge(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const
+    {
+        return count_;
+    }
+
+    uint64_t max() const
+    {
+        return max_;
+    }
+
+    /**
+     * The smallest value at least a fraction p of the recorded values
+     * are no greater than, rounded up to the top of its bucket (never
+     * past the largest value seen). 0 when empty.
+     */
+    uint64_t percentile(double p) const
+    {
+        if (count_ == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * (double)count_ + 0.5);
+        rank = std::max(rank, (uint64_t)1);
+        uint64_t seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            seen += counts_[i];
+            // the last bucket has no top: everything past the range lands there
+            if (seen >= rank)
+            {
+                return i == LATENCY_BUCKETS - 1 ? max_ : std::min(bucketTop(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    LatencySummary summarize() const
+    {
+        LatencySummary summary;
+        if (count_ == 0)
+        {
+            return summary;
+        }
+        double perNs = latencyTicksPerNs();
+        summary.count = count_;
+        summary.meanNs = (double)sum_ / (double)count_ / perNs;
+        summary.p50Ns = percentile(0.5) / perNs;
+        summary.p99Ns = percentile(0.99) / perNs;
+        summary.p999Ns = percentile(0.999) / perNs;
+        summary.maxNs = max_ / perNs;
+        return summary;
+    }
+
+protected:
+    static int bucketOf(uint64_t ticks)
+    {
+        if (ticks < ((uint64_t)1 << LATENCY_SUB_BITS))
+        {
+            return (int)ticks;
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        int exponent = 63 - __builtin_clzll(ticks);
+#else
+        int exponent = 0;
+        while ((ticks >> exponent) > 1)
+        {
+            exponent++;
+        }
+#endif
+        if (exponent > LATENCY_MAX_EXPONENT)
+        {
+            return LATENCY_BUCKETS - 1;
+        }
+        int sub = (int)(ticks >> (exponent - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+        return ((exponent - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+    }
+
+    // largest value that lands in bucket i
+    static uint64_t bucketTop(int i)
+    {
+        if (i < (1 << LATENCY_SUB_BITS))
+        {
+            return (uint64_t)i;
+        }
+        int exponent = (i >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+        uint64_t sub = (uint64_t)(i & ((1 << LATENCY_SUB_BITS) - 1));
+        int shift = exponent - LATENCY_SUB_BITS;
+        return ((((uint64_t)1 << LATENCY_SUB_BITS) + sub + 1) << shift) - 1;
+    }
+
+    uint64_t counts_[LATENCY_BUCKETS];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+#endif
@@ -0,0 +1,465 @@
+#ifndef MAPPED_AVL_H
+#define MAPPED_AVL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+/**
+ * One node of a tree image. Children are named by their distance in
+ * records from this one (0 for none) rather than by address, so the file
+ * means the same thing wherever it is mapped.
+ */
+template <typename Key, typename Value>
+struct MappedAVLNode
+{
+    std::pair<Key, Value> item;
+    int32_t left;
+    int32_t right;
+};
+
+/**
+ * Start of a tree image file. Records follow right after it, root in
+ * the middle: the layout is in key order, so a range scan reads the file
+ * front to back.
+ */
+struct MappedAVLHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t recordSize;
+    uint64_t count;
+};
+
+static const char MAPPED_AVL_MAGIC[8] = {'B', 'S', 'T', 'I', 'M', 'A', 'G', 'E'};
+static const uint32_t MAPPED_AVL_VERSION = 1;
+
+/**
+ * A read-only AVL map served straight from an mmap()ed tree image. Opening
+ * one costs a header check however large the file is; pages are read in
+ * as lookups touch them, and every process mapping the same file shares
+ * one copy in the page cache.
+ *
+ * write() produces an image from items in key order (any tree's begin(),
+ * for instance) as a perfectly balanced tree, so lookups descend at most
+ * log2(n) + 1 levels. Keys and values must be trivially copyable, and,
+ * as with snapshots, the image is read back on the machine type that
+ * wrote it. Repeated keys are kept; find() returns the first.
+ */
+template <typename Key, typename Value>
+class MappedAVLTree
+{
+public:
+    typedef MappedAVLNode<Key, Value> MNode;
+
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "MappedAVLTree needs trivially copyable keys and values");
+
+    // maps the image at path; a missing or malformed file throws
+    // std::runtime_error
+    explicit MappedAVLTree(const std::string &path);
+    ~MappedAVLTree();
+
+    // writes count items from first on, which must be in key order
+    // (std::invalid_argument otherwise), to a temporary file renamed over
+    // path once synced; on any error path keeps its previous image, which
+    // processes that have it mapped go on reading either way
+    template <typename InputIterator>
+    static void write(const std::string &path, InputIterator first, size_t count);
+    template <typename Tree>
+    static void write(const std::string &path, const Tree &tree);
+
+    bool empty() const;
+    size_t size() const;
+
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<Key, Value> *pointer;
+        typedef const std::pair<Key, Value> &reference;
+
+        iterator();
+
+        const std::pair<Key, Value> &operator*() const;
+        const std::pair<Key, Value> *operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+        iterator operator++(int);
+        iterator &operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class MappedAVLTree<Key, Value>;
+        explicit iterator(const MNode *node);
+        const MNode *current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+    // first item with key >= / > the given one, for range scans
+    iterator lower_bound(const Key &key) const;
+    iterator upper_bound(const Key &key) const;
+    Value const &operator[](const Key &key) const;
+
+protected:
+    // record index of the subtree root over records [lo, hi)
+    static size_t middle(size_t lo, size_t hi);
+    template <typename InputIterator>
+    static void writeRange(SnapshotWriter &out, InputIterator &next, size_t lo, size_t hi, Key &last);
+    // descends from the root; with strict set, finds the first key > key
+    const MNode *bound(const Key &key, bool strict) const;
+    const MNode *child(const MNode *node, int32_t offset) const;
+
+    void *map_;
+    size_t mapBytes_;
+    const MNode *nodes_;
+    size_t count_;
+
+private:
+    MappedAVLTree(const MappedAVLTree &);
+    MappedAVLTree &operator=(const MappedAVLTree &);
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the MappedAVLTree::iterator class.
+--------------------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+MappedAVLTree<Key, Value>::iterator::iterator() : current_(nullptr)
+{
+}
+
+template <typename Key, typename Value>
+MappedAVLTree<Key, Value>::iterator::iterator(const MNode *node) : current_(node)
+{
+}
+
+template <typename Key, typename Value>
+const std::pair<Key, Value> &MappedAVLTree<Key, Value>::iterator::operator*() const
+{
+    return current_->item;
+}
+
+template <typename Key, typename Value>
+const std::pair<Key, Value> *MappedAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(current_->item);
+}
+
+template <typename Key, typename Value>
+bool MappedAVLTree<Key, Value>::iterator::operator==(const iterator &rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template <typename Key, typename Value>
+bool MappedAVLTree<Key, Value>::iterator::operator!=(const iterator &rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+ * Records are in key order, so the successor is simply the next one.
+ */
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator &MappedAVLTree<Key, Value>::iterator::operator++()
+{
+    ++current_;
+    return *this;
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::iterator::operator++(int)
+{
+    iterator old = *this;
+    ++current_;
+    return old;
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator &MappedAVLTree<Key, Value>::iterator::operator--()
+{
+    --current_;
+    return *this;
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::iterator::operator--(int)
+{
+    iterator old = *this;
+    --current_;
+    return old;
+}
+
+/*
+---------------------------------------------------
+Begin implementations for the MappedAVLTree class.
+---------------------------------------------------
+*/
+
+/**
+ * Checks the header and that the file really holds count records before
+ * handing out any pointer into it.
+ */
+template <typename Key, typename Value>
+MappedAVLTree<Key, Value>::MappedAVLTree(const std::string &path) : map_(nullptr), mapBytes_(0), nodes_(nullptr), count_(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(MappedAVLHeader))
+    {
+        ::close(fd);
+        throw std::runtime_error(path + " is not a tree image");
+    }
+    mapBytes_ = (size_t)info.st_size;
+    map_ = ::mmap(nullptr, mapBytes_, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    if (map_ == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map " + path);
+    }
+
+    const MappedAVLHeader *header = static_cast<const MappedAVLHeader *>(map_);
+    const char *problem = nullptr;
+    if (std::memcmp(header->magic, MAPPED_AVL_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != MAPPED_AVL_VERSION)
+    {
+        problem = " is not a tree image";
+    }
+    else if (header->keySize != sizeof(Key) || header->valueSize != sizeof(Value) ||
+             header->recordSize != sizeof(MNode))
+    {
+        problem = " holds different key or value types";
+    }
+    else if (header->count > (mapBytes_ - sizeof(MappedAVLHeader)) / sizeof(MNode))
+    {
+        problem = " is truncated";
+    }
+    if (problem != nullptr)
+    {
+        ::munmap(map_, mapBytes_);
+        throw std::runtime_error(path + problem);
+    }
+    count_ = (size_t)header->count;
+    nodes_ = reinterpret_cast<const MNode *>(static_cast<const char *>(map_) + sizeof(MappedAVLHeader));
+}
+
+template <typename Key, typename Value>
+MappedAVLTree<Key, Value>::~MappedAVLTree()
+{
+    ::munmap(map_, mapBytes_);
+}
+
+template <typename Key, typename Value>
+bool MappedAVLTree<Key, Value>::empty() const
+{
+    return count_ == 0;
+}
+
+template <typename Key, typename Value>
+size_t MappedAVLTree<Key, Value>::size() const
+{
+    return count_;
+}
+
+template <typename Key, typename Value>
+size_t MappedAVLTree<Key, Value>::middle(size_t lo, size_t hi)
+{
+    // same split as BinarySearchTree::buildSorted()
+    return lo + (hi - lo) / 2;
+}
+
+template <typename Key, typename Value>
+template <typename InputIterator>
+void MappedAVLTree<Key, Value>::write(const std::string &path, InputIterator first, size_t count)
+{
+    if (count > (size_t)INT32_MAX)
+    {
+        throw std::length_error("Too many items for a tree image");
+    }
+    MappedAVLHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAPPED_AVL_MAGIC, sizeof(header.magic));
+    header.version = MAPPED_AVL_VERSION;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.recordSize = sizeof(MNode);
+    header.count = count;
+
+    // never write the live image in place: a process mapping it would
+    // fault on the truncated pages
+    std::string temp = snapshotTempPath(path);
+    try
+    {
+        SnapshotWriter out(temp);
+        out.write(&header, sizeof(header));
+        Key last = Key();
+        writeRange(out, first, 0, count, last);
+        out.close();
+    }
+    catch (...)
+    {
+        std::remove(temp.c_str());
+        throw;
+    }
+    publishFile(temp, path);
+}
+
+template <typename Key, typename Value>
+template <typename Tree>
+void MappedAVLTree<Key, Value>::write(const std::string &path, const Tree &tree)
+{
+    write(path, tree.begin(), tree.size());
+}
+
+/**
+ * Emits records lo..hi-1 in order. Each record's child offsets follow
+ * from the index ranges alone, so nothing has to be patched afterwards
+ * and the items are read once, front to back.
+ */
+template <typename Key, typename Value>
+template <typename InputIterator>
+void MappedAVLTree<Key, Value>::writeRange(SnapshotWriter &out, InputIterator &next, size_t lo, size_t hi, Key &last)
+{
+    if (lo >= hi)
+    {
+        return;
+    }
+    size_t mid = middle(lo, hi);
+    writeRange(out, next, lo, mid, last);
+
+    MNode record;
+    // zero the padding too, so equal trees give equal files
+    std::memset(static_cast<void *>(&record), 0, sizeof(record));
+    record.item.first = next->first;
+    record.item.second = next->second;
+    // mid > 0 exactly when some record has been written before this one
+    if (mid > 0 && record.item.first < last)
+    {
+        throw std::invalid_argument("Items for a tree image must be in key order");
+    }
+    last = record.item.first;
+    record.left = (lo < mid) ? (int32_t)middle(lo, mid) - (int32_t)mid : 0;
+    record.right = (mid + 1 < hi) ? (int32_t)middle(mid + 1, hi) - (int32_t)mid : 0;
+    out.write(&record, sizeof(record));
+    ++next;
+
+    writeRange(out, next, mid + 1, hi, last);
+}
+
+template <typename Key, typename Value>
+const typename MappedAVLTree<Key, Value>::MNode *MappedAVLTree<Key, Value>::child(const MNode *node, int32_t offset) const
+{
+    if (offset == 0)
+    {
+        return nullptr;
+    }
+    const MNode *target = node + offset;
+    // a damaged image must not send us outside the mapping
+    if (target < nodes_ || target >= nodes_ + count_)
+    {
+        throw std::runtime_error("Tree image is corrupt");
+    }
+    return target;
+}
+
+/**
+ * Ordinary lower/upper bound descent, remembering the last node where
+ * the search turned left.
+ */
+template <typename Key, typename Value>
+const typename MappedAVLTree<Key, Value>::MNode *MappedAVLTree<Key, Value>::bound(const Key &key, bool strict) const
+{
+    const MNode *best = nodes_ + count_;
+    const MNode *curr = (count_ == 0) ? nullptr : nodes_ + middle(0, count_);
+    while (curr != nullptr)
+    {
+        bool goLeft = strict ? (key < curr->item.first) : !(curr->item.first < key);
+        if (goLeft)
+        {
+            best = curr;
+            curr = child(curr, curr->left);
+        }
+        else
+        {
+            curr = child(curr, curr->right);
+        }
+    }
+    return best;
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::begin() const
+{
+    return iterator(nodes_);
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::end() const
+{
+    return iterator(nodes_ + count_);
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::lower_bound(const Key &key) const
+{
+    return iterator(bound(key, false));
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::upper_bound(const Key &key) const
+{
+    return iterator(bound(key, true));
+}
+
+template <typename Key, typename Value>
+typename MappedAVLTree<Key, Value>::iterator MappedAVLTree<Key, Value>::find(const Key &key) const
+{
+    const MNode *found = bound(key, false);
+    if (found == nodes_ + count_ || key < found->item.first)
+    {
+        return end();
+    }
+    return iterator(found);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <typename Key, typename Value>
+Value const &MappedAVLTree<Key, Value>::operator[](const Key &key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef PARALLEL_BUILD_H
+#define PARALLEL_BUILD_H
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include "bst.h"
+
+// below this many items a range is sorted, merged or built on one thread
+static const size_t PARALLEL_GRAIN = 1 << 15;
+
+namespace parallel_detail
+{
+    // runs a task, keeping any exception for the thread that joins it
+    template <typename Task>
+    struct Captured
+    {
+        Task *task;
+        std::exception_ptr *error;
+        void operator()()
+        {
+            try
+            {
+                (*task)();
+            }
+            catch (...)
+            {
+                *error = std::current_exception();
+            }
+        }
+    };
+
+    /**
+     * Runs left() on a new thread and right() on this one, then waits for
+     * both; if no thread can be started, left() runs here first. Once
+     * both are done an exception from either is rethrown, left's first,
+     * so the caller can free whatever the other one built.
+     */
+    template <typename Left, typename Right>
+    void forkJoin(Left &left, Right &right)
+    {
+        std::exception_ptr leftError;
+        std::exception_ptr rightError;
+        Captured<Left> job;
+        job.task = &left;
+        job.error = &leftError;
+        std::thread worker;
+        try
+        {
+            worker = std::thread(job);
+        }
+        catch (const std::system_error &)
+        {
+            job();
+        }
+        Captured<Right> here;
+        here.task = &right;
+        here.error = &rightError;
+        here();
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+        if (leftError)
+        {
+            std::rethrow_exception(leftError);
+        }
+        if (rightError)
+        {
+            std::rethrow_exception(rightError);
+        }
+    }
+
+    template <typename Item>
+    struct KeyLess
+    {
+        bool operator()(const Item &a, const Item &b) const
+        {
+            return a.first < b.first;
+        }
+    };
+
+    /**
+     * Stable merge of [a, aEnd) and [b, bEnd) into out, moving the items.
+     * Big merges split at the middle of the longer input and a binary
+     * search in the other, and the two halves merge side by side; items
+     * from a still go before equal items from b on both sides of the cut.
+     */
+    template <typename Item>
+    struct MergeTask
+    {
+        Item *a;
+        Item *aEnd;
+        Item *b;
+        Item *bEnd;
+        Item *out;
+        unsigned threads;
+
+        void operator()()
+        {
+            KeyLess<Item> less;
+            size_t total = (size_t)(aEnd - a) + (size_t)(bEnd - b);
+            if (threads <= 1 || total < PARALLEL_GRAIN)
+            {
+                std::merge(std::make_move_iterator(a), std::make_move_iterator(aEnd),
+                           std::make_move_iterator(b), std::make_move_iterator(bEnd), out, less);
+                return;
+            }
+            Item *aCut;
+            Item *bCut;
+            if (aEnd - a >= bEnd - b)
+            {
+                aCut = a + (aEnd - a) / 2;
+                bCut = std::lower_bound(b, bEnd, *aCut, less);
+            }
+            else
+            {
+                bCut = b + (bEnd - b) / 2;
+                aCut = std::upper_bound(a, aEnd, *bCut, less);
+            }
+            MergeTask low = {a, aCut, b, bCut, out, threads / 2};
+            MergeTask high = {aCut, aEnd, bCut, bEnd, out + (aCut - a) + (bCut - b), threads - threads / 2};
+            forkJoin(low, high);
+        }
+    };
+
+    /**
+     * Stable merge sort of [first, last) on up to threads threads, with
+     * scratch the same length. The sorted items end up in scratch when
+     * intoScratch is set and in place otherwise, so each level of merging
+     * moves them across once instead of there and back.
+     */
+    template <typename Item>
+    struct SortTask
+    {
+        Item *first;
+        Item *last;
+        Item *scratch;
+        bool intoScratch;
+        unsigned threads;
+
+        void operator()()
+        {
+            size_t count = (size_t)(last - first);
+            if (threads <= 1 || count < PARALLEL_GRAIN)
+            {
+                std::stable_sort(first, last, KeyLess<Item>());
+                if (intoScratch)
+                {
+                    std::move(first, last, scratch);
+                }
+                return;
+            }
+            size_t half = count / 2;
+            // the halves land wherever this level's merge reads from
+            SortTask left = {first, first + half, scratch, !intoScratch, threads / 2};
+            SortTask right = {first + half, last, scratch + half, !intoScratch, threads - threads / 2};
+            forkJoin(left, right);
+            Item *from = intoScratch ? first : scratch;
+            Item *to = intoScratch ? scratch : first;
+            MergeTask<Item> merge = {from, from + half, from + half, from + count, to, threads};
+            merge();
+        }
+    };
+}
+
+/**
+ * Builds a BinarySearchTree, or any tree derived from it, on several
+ * threads. build() takes items in any order: a stable parallel merge sort
+ * puts them in key order, and in map mode only the last item of each key
+ * is kept, as if they had been inserted in turn. The tree is then built
+ * in the same shape as assignSorted() gives, but the two halves under
+ * each of the top nodes are built at once, on threads forked for the
+ * purpose, until there is one subtree per thread. The halves are equal
+ * in size, so no thread waits long for its sibling.
+ *
+ * Each subtree's nodes are allocated by the thread that builds it; the
+ * allocator gives threads their own arenas, so they do not contend, and
+ * the nodes are still freed one by one as the tree changes.
+ */
+template <typename Key, typename Value>
+class ParallelBuilder
+{
+public:
+    typedef std::pair<Key, Value> Item;
+
+    // threads 0 means std::thread::hardware_concurrency()
+    explicit ParallelBuilder(unsigned threads = 0);
+
+    unsigned threads() const;
+
+    // replaces tree's contents with items, which are sorted (and, for a
+    // map-mode tree, reduced to one per key) in place
+    void build(BinarySearchTree<Key, Value> &tree, std::vector<Item> &items) const;
+    // count items from first on, already in key order; otherwise
+    // std::invalid_argument, leaving tree empty
+    void assignSorted(BinarySearchTree<Key, Value> &tree, const Item *first, size_t count) const;
+    void sort(std::vector<Item> &items) const;
+
+protected:
+    // reads items in order, for BinarySearchTree::buildSorted()
+    struct ItemSource
+    {
+        const Item *next;
+        void operator()(Key &key, Value &value)
+        {
+            key = next->first;
+            value = next->second;
+            ++next;
+        }
+    };
+
+    // one subtree: its root, first and last nodes in order, and height
+    struct BuildTask
+    {
+        BinarySearchTree<Key, Value> *tree;
+        const Item *first;
+        size_t count;
+        unsigned threads;
+        Node<Key, Value> *root;
+        Node<Key, Value> *lo;
+        Node<Key, Value> *hi;
+        int height;
+        void operator()();
+    };
+
+    static void buildRange(BuildTask &task);
+    // keeps the last of each run of equal keys; items must be sorted
+    static void keepLast(std::vector<Item> &items);
+
+    unsigned threads_;
+};
+
+/*
+----------------------------------------------------
+Begin implementations for the ParallelBuilder class.
+----------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+ParallelBuilder<Key, Value>::ParallelBuilder(unsigned threads) : threads_(threads)
+{
+    if (threads_ == 0)
+    {
+        threads_ = std::thread::hardware_concurrency();
+    }
+    if (threads_ == 0)
+    {
+        threads_ = 1;
+    }
+}
+
+template <typename Key, typename Value>
+unsigned ParallelBuilder<Key, Value>::threads() const
+{
+    return threads_;
+}
+
+template <typename Key, typename Value>
+void ParallelBuilder<Key, Value>::sort(std::vector<Item> &items) const
+{
+    if (items.size() < 2)
+    {
+        return;
+    }
+    if (threads_ <= 1 || items.size() < PARALLEL_GRAIN)
+    {
+        std::stable_sort(items.begin(), items.end(), parallel_detail::KeyLess<Item>());
+        return;
+    }
+    std::vector<Item> scratch(items.size());
+    parallel_detail::SortTask<Item> task = {&items[0], &items[0] + items.size(), &scratch[0], false, threads_};
+    task();
+}
+
+template <typename Key, typename Value>
+void ParallelBuilder<Key, Value>::keepLast(std::vector<Item> &items)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (kept > 0 && !(items[kept - 1].first < items[i].first))
+        {
+            items[kept - 1].second = std::move(items[i].second);
+        }
+        else
+        {
+            if (kept != i)
+            {
+                items[kept] = std::move(items[i]);
+            }
+            kept++;
+        }
+    }
+    items.erase(items.begin() + kept, items.end());
+}
+
+template <typename Key, typename Value>
+void ParallelBuilder<Key, Value>::build(BinarySearchTree<Key, Value> &tree, std::vector<Item> &items) const
+{
+    sort(items);
+    if (!tree.multi_)
+    {
+        keepLast(items);
+    }
+    assignSorted(tree, items.empty() ? nullptr : &items[0], items.size());
+}
+
+template <typename Key, typename Value>
+void ParallelBuilder<Key, Value>::assignSorted(BinarySearchTree<Key, Value> &tree, const Item *first, size_t count) const
+{
+    tree.clear();
+    BuildTask task = {&tree, first, count, threads_, nullptr, nullptr, nullptr, 0};
+    task();
+    tree.adoptBuilt(task.root, count, task.hi);
+}
+
+template <typename Key, typename Value>
+void ParallelBuilder<Key, Value>::BuildTask::operator()()
+{
+    buildRange(*this);
+}
+
+/**
+ * Small ranges go to the tree's own buildSorted(). Above that the middle
+ * item's node joins two subtrees built in parallel: its order is checked
+ * against their end nodes, and the threads are linked across it, which
+ * buildSorted() would have done with its prev pointer.
+ */
+template <typename Key, typename Value>
+void ParallelBuilder<Key, Value>::buildRange(BuildTask &task)
+{
+    BinarySearchTree<Key, Value> &tree = *task.tree;
+    if (task.threads <= 1 || task.count < PARALLEL_GRAIN)
+    {
+        ItemSource source;
+        source.next = task.first;
+        Node<Key, Value> *prev = nullptr;
+        task.root = tree.buildSorted(task.count, source, prev, task.height);
+        task.hi = prev;
+        task.lo = task.root;
+        while (task.lo != nullptr && task.lo->getLeft() != nullptr)
+        {
+            task.lo = task.lo->getLeft();
+        }
+        return;
+    }
+
+    size_t half = task.count / 2;
+    BuildTask left = {task.tree, task.first, half, task.threads / 2, nullptr, nullptr, nullptr, 0};
+    BuildTask right = {task.tree, task.first + half + 1, task.count - half - 1, task.threads - task.threads / 2,
+                       nullptr, nullptr, nullptr, 0};
+    Node<Key, Value> *node;
+    try
+    {
+        parallel_detail::forkJoin(left, right);
+        const Key &key = task.first[half].first;
+        const Key &before = left.hi->getKey();
+        const Key &after = right.lo->getKey();
+        if (key < before || after < key || (!tree.multi_ && (!(before < key) || !(key < after))))
+        {
+            throw std::invalid_argument("Items are out of key order");
+        }
+        node = tree.createNode(key, task.first[half].second, nullptr);
+    }
+    catch (...)
+    {
+        BinarySearchTree<Key, Value>::deleteSubtree(left.root);
+        BinarySearchTree<Key, Value>::deleteSubtree(right.root);
+        throw;
+    }
+    node->setLeft(left.root);
+    left.root->setParent(node);
+    node->setRight(right.root);
+    right.root->setParent(node);
+    if (tree.threaded_)
+    {
+        BinarySearchTree<Key, Value>::threadLink(left.hi, node);
+        BinarySearchTree<Key, Value>::threadLink(node, right.lo);
+    }
+    tree.builtNode(node, left.height, right.height);
+
+    task.root = node;
+    task.lo = left.lo;
+    task.hi = right.hi;
+    task.height = 1 + std::max(left.height, right.height);
+}
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef PARALLEL_TRAVERSAL_H
+#define PARALLEL_TRAVERSAL_H
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <system_error>
+#include "bst.h"
+
+namespace parallel_detail
+{
+    /**
+     * Runs task(i) for every i in [0, count) on up to threads threads,
+     * the calling one included. The indices start dealt out in equal
+     * contiguous blocks, one per thread; each thread works through its
+     * own block from the front, and one that runs dry steals the back
+     * half of another's. Tasks do not add tasks, so a thread leaves once
+     * it finds every block empty. If a task throws, no new tasks start
+     * and the first exception is rethrown here.
+     */
+    class WorkStealingPool
+    {
+    public:
+        template <typename Task>
+        static void run(size_t count, unsigned threads, Task &task);
+
+    protected:
+        struct Block
+        {
+            std::mutex lock;
+            size_t lo;
+            size_t hi;
+        };
+
+        template <typename Task>
+        struct Worker
+        {
+            std::vector<Block> *blocks;
+            size_t self;
+            Task *task;
+            std::atomic<bool> *failed;
+            std::exception_ptr *error;
+            std::mutex *errorLock;
+            void operator()();
+            bool take(size_t &index);
+            bool steal();
+        };
+    };
+
+    template <typename Task>
+    void WorkStealingPool::run(size_t count, unsigned threads, Task &task)
+    {
+        if (threads < 1)
+        {
+            threads = 1;
+        }
+        if (threads > count)
+        {
+            threads = (count == 0) ? 1 : (unsigned)count;
+        }
+        std::vector<Block> blocks(threads);
+        for (size_t i = 0; i < threads; i++)
+        {
+            blocks[i].lo = count * i / threads;
+            blocks[i].hi = count * (i + 1) / threads;
+        }
+        std::atomic<bool> failed(false);
+        std::exception_ptr error;
+        std::mutex errorLock;
+
+        std::vector<Worker<Task> > workers(threads);
+        for (size_t i = 0; i < threads; i++)
+        {
+            Worker<Task> worker = {&blocks, i, &task, &failed, &error, &errorLock};
+            workers[i] = worker;
+        }
+        std::vector<std::thread> started;
+        for (size_t i = 1; i < threads; i++)
+        {
+            try
+            {
+                started.push_back(std::thread(workers[i]));
+            }
+            catch (const std::system_error &)
+            {
+                // its block gets stolen instead
+                break;
+            }
+        }
+        workers[0]();
+        for (size_t i = 0; i < started.size(); i++)
+        {
+            started[i].join();
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    template <typename Task>
+    void WorkStealingPool::Worker<Task>::operator()()
+    {
+        size_t index;
+        while (!*failed && (take(index) || (steal() && take(index))))
+        {
+            try
+            {
+                (*task)(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(*errorLock);
+                if (!*error)
+                {
+                    *error = std::current_exception();
+                }
+                *failed = true;
+            }
+        }
+    }
+
+    template <typename Task>
+    bool WorkStealingPool::Worker<Task>::take(size_t &index)
+    {
+        Block &own = (*blocks)[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.lo == own.hi)
+        {
+            return false;
+        }
+        index = own.lo++;
+        return true;
+    }
+
+    template <typename Task>
+    bool WorkStealingPool::Worker<Task>::steal()
+    {
+        size_t n = blocks->size();
+        for (size_t step = 1; step < n; step++)
+        {
+            Block &victim = (*blocks)[(self + step) % n];
+            size_t lo;
+            size_t hi;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (victim.lo == victim.hi)
+                {
+                    continue;
+                }
+                hi = victim.hi;
+                lo = victim.hi - (victim.hi - victim.lo + 1) / 2;
+                victim.hi = lo;
+            }
+            Block &own = (*blocks)[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.lo = lo;
+            own.hi = hi;
+            return true;
+        }
+        return false;
+    }
+}
+
+/**
+ * Whole-tree traversals on several threads, for BinarySearchTree and the
+ * trees derived from it. The top levels of the tree are cut into pieces,
+ * listed in key order: whole subtrees a few levels down, and the single
+ * nodes above them. With about eight pieces per thread on a work-stealing
+ * pool, the uneven subtree sizes of an AVL tree even out. Each piece is
+ * walked with the same successor steps as an iterator (thread links, if
+ * the tree has them), stopping at its rightmost node.
+ *
+ * Nodes hold no subtree sizes, so to_vector() finds each piece's offset
+ * from a counting pass over the pieces, run on the pool as well; only
+ * the total comes from size(). The tree must not change while any of
+ * these run.
+ */
+template <typename Key, typename Value>
+class ParallelTraversal
+{
+public:
+    typedef std::pair<const Key, Value> Item;
+
+    // threads 0 means std::thread::hardware_concurrency()
+    static unsigned resolveThreads(unsigned threads);
+
+    template <typename Function>
+    static void forEach(BinarySearchTree<Key, Value> &tree, Function &f, unsigned threads);
+    template <typename T, typename Map, typename Combine>
+    static T reduce(const BinarySearchTree<Key, Value> &tree, const T &identity, Map &map, Combine &combine, unsigned threads);
+    template <typename T, typename Project>
+    static void toVector(const BinarySearchTree<Key, Value> &tree, std::vector<T> &out, Project &project, unsigned threads);
+
+protected:
+    // a whole subtree, or with single set just its root; threaded is the
+    // tree's, for nextNode()
+    struct Piece
+    {
+        Node<Key, Value> *node;
+        bool single;
+        bool threaded;
+    };
+
+    // a result slot per piece; a struct so std::vector<bool> is never used
+    template <typename T>
+    struct Slot
+    {
+        T value;
+    };
+
+    template <typename Function>
+    struct ForEachTask
+    {
+        const std::vector<Piece> *pieces;
+        Function *f;
+        void operator()(size_t i);
+    };
+
+    template <typename T, typename Map, typename Combine>
+    struct ReduceTask
+    {
+        const std::vector<Piece> *pieces;
+        std::vector<Slot<T> > *results;
+        Map *map;
+        Combine *combine;
+        void operator()(size_t i);
+    };
+
+    struct CountTask
+    {
+        const std::vector<Piece> *pieces;
+        std::vector<size_t> *sizes;
+        void operator()(size_t i);
+    };
+
+    template <typename T, typename Project>
+    struct CopyTask
+    {
+        const std::vector<Piece> *pieces;
+        const std::vector<size_t> *offsets;
+        std::vector<T> *out;
+        Project *project;
+        void operator()(size_t i);
+    };
+
+    static void split(const BinarySearchTree<Key, Value> &tree, unsigned threads, std::vector<Piece> &pieces);
+    static void collect(Node<Key, Value> *node, int depth, int splitDepth, bool threaded, std::vector<Piece> &pieces);
+    // first and last node of a piece, for walking it with nextNode()
+    static Node<Key, Value> *first(const Piece &piece);
+    static Node<Key, Value> *last(const Piece &piece);
+};
+
+template <typename Key, typename Value, typename Function>
+void parallel_for_each(BinarySearchTree<Key, Value> &tree, Function f, unsigned threads = 0);
+
+// combine must be associative; pieces are combined in key order, so it
+// need not be commutative
+template <typename Key, typename Value, typename T, typename Map, typename Combine>
+T parallel_reduce(const BinarySearchTree<Key, Value> &tree, T identity, Map map, Combine combine, unsigned threads = 0);
+
+// project(item) for every item, in key order, e.g. one column of a
+// columnar export
+template <typename Key, typename Value, typename T, typename Project>
+void to_vector(const BinarySearchTree<Key, Value> &tree, std::vector<T> &out, Project project, unsigned threads = 0);
+template <typename Key, typename Value>
+std::vector<std::pair<Key, Value> > to_vector(const BinarySearchTree<Key, Value> &tree, unsigned threads = 0);
+
+/*
+-------------------------------------------------------
+Begin implementations for the ParallelTraversal class.
+-------------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+unsigned ParallelTraversal<Key, Value>::resolveThreads(unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    return (threads == 0) ? 1 : threads;
+}
+
+/**
+ * Cuts deep enough for about eight pieces per thread; one thread takes
+ * the whole tree as a single piece.
+ */
+template <typename Key, typename Value>
+void ParallelTraversal<Key, Value>::split(const BinarySearchTree<Key, Value> &tree, unsigned threads, std::vector<Piece> &pieces)
+{
+    int splitDepth = 0;
+    if (threads > 1)
+    {
+        for (unsigned wanted = threads * 8; wanted > 1; wanted /= 2)
+        {
+            splitDepth++;
+        }
+    }
+    collect(tree.root_, 0, splitDepth, tree.threaded_, pieces);
+}
+
+template <typename Key, typename Value>
+void ParallelTraversal<Key, Value>::collect(Node<Key, Value> *node, int depth, int splitDepth, bool threaded,
+                                            std::vector<Piece> &pieces)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (depth == splitDepth)
+    {
+        Piece whole = {node, false, threaded};
+        pieces.push_back(whole);
+        return;
+    }
+    collect(node->getLeft(), depth + 1, splitDepth, threaded, pieces);
+    Piece single = {node, true, threaded};
+    pieces.push_back(single);
+    collect(node->getRight(), depth + 1, splitDepth, threaded, pieces);
+}
+
+template <typename Key, typename Value>
+Node<Key, Value> *ParallelTraversal<Key, Value>::first(const Piece &piece)
+{
+    Node<Key, Value> *node = piece.node;
+    while (!piece.single && node->getLeft() != nullptr)
+    {
+        node = node->getLeft();
+    }
+    return node;
+}
+
+template <typename Key, typename Value>
+Node<Key, Value> *ParallelTraversal<Key, Value>::last(const Piece &piece)
+{
+    Node<Key, Value> *node = piece.node;
+    while (!piece.single && node->getRight() != nullptr)
+    {
+        node = node->getRight();
+    }
+    return node;
+}
+
+template <typename Key, typename Value>
+template <typename Function>
+void ParallelTraversal<Key, Value>::ForEachTask<Function>::operator()(size_t i)
+{
+    const Piece &piece = (*pieces)[i];
+    Node<Key, Value> *stop = last(piece);
+    for (Node<Key, Value> *curr = first(piece);; curr = BinarySearchTree<Key, Value>::nextNode(curr, piece.threaded))
+    {
+        (*f)(curr->getItem());
+        if (curr == stop)
+        {
+            break;
+        }
+    }
+}
+
+template <typename Key, typename Value>
+template <typename T, typename Map, typename Combine>
+void ParallelTraversal<Key, Value>::ReduceTask<T, Map, Combine>::operator()(size_t i)
+{
+    const Piece &piece = (*pieces)[i];
+    Node<Key, Value> *stop = last(piece);
+    T &result = (*results)[i].value;
+    for (Node<Key, Value> *curr = first(piece);; curr = BinarySearchTree<Key, Value>::nextNode(curr, piece.threaded))
+    {
+        result = (*combine)(result, (*map)(curr->getItem()));
+        if (curr == stop)
+        {
+            break;
+        }
+    }
+}
+
+template <typename Key, typename Value>
+void ParallelTraversal<Key, Value>::CountTask::operator()(size_t i)
+{
+    const Piece &piece = (*pieces)[i];
+    if (piece.single)
+    {
+        (*sizes)[i] = 1;
+        return;
+    }
+    Node<Key, Value> *stop = last(piece);
+    size_t count = 1;
+    for (Node<Key, Value> *curr = first(piece); curr != stop; curr = BinarySearchTree<Key, Value>::nextNode(curr, piece.threaded))
+    {
+        count++;
+    }
+    (*sizes)[i] = count;
+}
+
+template <typename Key, typename Value>
+template <typename T, typename Project>
+void ParallelTraversal<Key, Value>::CopyTask<T, Project>::operator()(size_t i)
+{
+    const Piece &piece = (*pieces)[i];
+    Node<Key, Value> *stop = last(piece);
+    T *dest = &(*out)[(*offsets)[i]];
+    for (Node<Key, Value> *curr = first(piece);; curr = BinarySearchTree<Key, Value>::nextNode(curr, piece.threaded))
+    {
+        *dest++ = (*project)(curr->getItem());
+        if (curr == stop)
+        {
+            break;
+        }
+    }
+}
+
+template <typename Key, typename Value>
+template <typename Function>
+void ParallelTraversal<Key, Value>::forEach(BinarySearchTree<Key, Value> &tree, Function &f, unsigned threads)
+{
+    threads = resolveThreads(threads);
+    std::vector<Piece> pieces;
+    split(tree, threads, pieces);
+    ForEachTask<Function> task = {&pieces, &f};
+    parallel_detail::WorkStealingPool::run(pieces.size(), threads, task);
+}
+
+template <typename Key, typename Value>
+template <typename T, typename Map, typename Combine>
+T ParallelTraversal<Key, Value>::reduce(const BinarySearchTree<Key, Value> &tree, const T &identity, Map &map, Combine &combine, unsigned threads)
+{
+    threads = resolveThreads(threads);
+    std::vector<Piece> pieces;
+    split(tree, threads, pieces);
+    Slot<T> start = {identity};
+    std::vector<Slot<T> > results(pieces.size(), start);
+    ReduceTask<T, Map, Combine> task = {&pieces, &results, &map, &combine};
+    parallel_detail::WorkStealingPool::run(pieces.size(), threads, task);
+
+    T total = identity;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        total = combine(total, results[i].value);
+    }
+    return total;
+}
+
+template <typename Key, typename Value>
+template <typename T, typename Project>
+void ParallelTraversal<Key, Value>::toVector(const BinarySearchTree<Key, Value> &tree, std::vector<T> &out, Project &project, unsigned threads)
+{
+    threads = resolveThreads(threads);
+    std::vector<Piece> pieces;
+    split(tree, threads, pieces);
+    std::vector<size_t> offsets(pieces.size(), 0);
+    if (pieces.size() > 1)
+    {
+        std::vector<size_t> sizes(pieces.size());
+        CountTask count = {&pieces, &sizes};
+        parallel_detail::WorkStealingPool::run(pieces.size(), threads, count);
+        for (size_t i = 1; i < pieces.size(); i++)
+        {
+            offsets[i] = offsets[i - 1] + sizes[i - 1];
+        }
+    }
+    out.resize(tree.size());
+    CopyTask<T, Project> copy = {&pieces, &offsets, &out, &project};
+    parallel_detail::WorkStealingPool::run(pieces.size(), threads, copy);
+}
+
+template <typename Key, typename Value, typename Function>
+void parallel_for_each(BinarySearchTree<Key, Value> &tree, Function f, unsigned threads)
+{
+    ParallelTraversal<Key, Value>::forEach(tree, f, threads);
+}
+
+template <typename Key, typename Value, typename T, typename Map, typename Combine>
+T parallel_reduce(const BinarySearchTree<Key, Value> &tree, T identity, Map map, Combine combine, unsigned threads)
+{
+    return ParallelTraversal<Key, Value>::reduce(tree, identity, map, combine, threads);
+}
+
+namespace parallel_detail
+{
+    template <typename Key, typename Value>
+    struct CopyItem
+    {
+        std::pair<Key, Value> operator()(const std::pair<const Key, Value> &item) const
+        {
+            return std::pair<Key, Value>(item.first, item.second);
+        }
+    };
+}
+
+template <typename Key, typename Value, typename T, typename Project>
+void to_vector(const BinarySearchTree<Key, Value> &tree, std::vector<T> &out, Project project, unsigned threads)
+{
+    ParallelTraversal<Key, Value>::toVector(tree, out, project, threads);
+}
+
+template <typename Key, typename Value>
+std::vector<std::pair<Key, Value> > to_vector(const BinarySearchTree<Key, Value> &tree, unsigned threads)
+{
+    std::vector<std::pair<Key, Value> > out;
+    parallel_detail::CopyItem<Key, Value> copy;
+    ParallelTraversal<Key, Value>::toVector(tree, out, copy, threads);
+    return out;
+}
+
+#endif
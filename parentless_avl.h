@@ -0,0 +1,634 @@
+#ifndef PARENTLESS_AVL_H
+#define PARENTLESS_AVL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <stdexcept>
+
+/**
+ * A node for ParentlessAVLTree: two child pointers and no parent pointer
+ * or vtable. For uint32_t keys and values that is 32 bytes against the 48
+ * of an AVLNode<uint32_t, uint32_t>, and a rotation writes three links
+ * instead of six.
+ */
+template <typename Key, typename Value>
+class ParentlessAVLNode
+{
+public:
+    ParentlessAVLNode(const Key &key, const Value &value);
+
+    const Key &getKey() const;
+    Value &getValue();
+
+protected:
+    template <typename K, typename V>
+    friend class ParentlessAVLTree;
+
+    ParentlessAVLNode<Key, Value> *left_;
+    ParentlessAVLNode<Key, Value> *right_;
+    std::pair<const Key, Value> item_;
+    int8_t balance_;
+};
+
+template <typename Key, typename Value>
+ParentlessAVLNode<Key, Value>::ParentlessAVLNode(const Key &key, const Value &value) : left_(nullptr),
+                                                                                       right_(nullptr),
+                                                                                       item_(key, value),
+                                                                                       balance_(0)
+{
+}
+
+template <typename Key, typename Value>
+const Key &ParentlessAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template <typename Key, typename Value>
+Value &ParentlessAVLNode<Key, Value>::getValue()
+{
+    return item_.second;
+}
+
+/**
+ * An AVL map whose nodes have no parent pointers. insert() and remove()
+ * record the root-to-node path on the way down and rebalance along it, and
+ * iterators carry the ancestors they still have to visit in a fixed-size
+ * stack, so an in-order scan touches only child links.
+ *
+ * insert() overwrites existing keys like AVLTree. Any insert() or remove()
+ * invalidates every iterator, since their stacks may name moved nodes.
+ */
+template <typename Key, typename Value>
+class ParentlessAVLTree
+{
+public:
+    typedef ParentlessAVLNode<Key, Value> PNode;
+
+    // An AVL tree this tall needs over 10^13 nodes, far beyond memory.
+    static const int MAX_HEIGHT = 64;
+
+    ParentlessAVLTree();
+    ~ParentlessAVLTree();
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    void remove(const Key &key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value> &operator*() const;
+        std::pair<const Key, Value> *operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+
+    protected:
+        friend class ParentlessAVLTree<Key, Value>;
+        void pushLeftSpine(PNode *n);
+        PNode *top() const;
+
+        // the current node on top, with the ancestors still to be
+        // visited (those we went left from) beneath it
+        PNode *stack_[MAX_HEIGHT];
+        int depth_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+    Value &operator[](const Key &key);
+    Value const &operator[](const Key &key) const;
+
+protected:
+    // A root-to-node path: nodes_[i] is the i-th ancestor and wentLeft_[i]
+    // says which child of it the path continues through.
+    struct Path
+    {
+        PNode *nodes_[MAX_HEIGHT];
+        bool wentLeft_[MAX_HEIGHT];
+        int depth_;
+
+        Path() : depth_(0) {}
+        void push(PNode *n, bool left);
+    };
+
+    PNode *internalFind(const Key &key) const;
+    void attach(const Path &path, int i, PNode *child);
+    static PNode *rotateLeft(PNode *n);
+    static PNode *rotateRight(PNode *n);
+    void insertFix(Path &path);
+    void removeFix(Path &path, int i);
+
+    PNode *root_;
+    size_t size_;
+
+private:
+    // owns raw nodes
+    ParentlessAVLTree(const ParentlessAVLTree &);
+    ParentlessAVLTree &operator=(const ParentlessAVLTree &);
+};
+
+/*
+----------------------------------------------------------------
+Begin implementations for the ParentlessAVLTree::iterator class.
+----------------------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+ParentlessAVLTree<Key, Value>::iterator::iterator() : depth_(0)
+{
+}
+
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::PNode *ParentlessAVLTree<Key, Value>::iterator::top() const
+{
+    return depth_ == 0 ? nullptr : stack_[depth_ - 1];
+}
+
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::iterator::pushLeftSpine(PNode *n)
+{
+    while (n != nullptr)
+    {
+        stack_[depth_++] = n;
+        n = n->left_;
+    }
+}
+
+template <typename Key, typename Value>
+std::pair<const Key, Value> &ParentlessAVLTree<Key, Value>::iterator::operator*() const
+{
+    return top()->item_;
+}
+
+template <typename Key, typename Value>
+std::pair<const Key, Value> *ParentlessAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(top()->item_);
+}
+
+template <typename Key, typename Value>
+bool ParentlessAVLTree<Key, Value>::iterator::operator==(const iterator &rhs) const
+{
+    return top() == rhs.top();
+}
+
+template <typename Key, typename Value>
+bool ParentlessAVLTree<Key, Value>::iterator::operator!=(const iterator &rhs) const
+{
+    return top() != rhs.top();
+}
+
+/**
+ * The successor is the leftmost node of the right subtree if there is one,
+ * otherwise the nearest ancestor we went left from -- which is exactly what
+ * is left on the stack once the current node is popped.
+ */
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::iterator &ParentlessAVLTree<Key, Value>::iterator::operator++()
+{
+    PNode *curr = stack_[--depth_];
+    pushLeftSpine(curr->right_);
+    return *this;
+}
+
+/*
+------------------------------------------------------
+Begin implementations for the ParentlessAVLTree class.
+------------------------------------------------------
+*/
+
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::Path::push(PNode *n, bool left)
+{
+    // the node below this path would sit at depth depth_ + 2
+    if (depth_ + 1 >= MAX_HEIGHT)
+    {
+        throw std::length_error("ParentlessAVLTree is too tall");
+    }
+    nodes_[depth_] = n;
+    wentLeft_[depth_] = left;
+    depth_++;
+}
+
+template <typename Key, typename Value>
+ParentlessAVLTree<Key, Value>::ParentlessAVLTree() : root_(nullptr), size_(0)
+{
+}
+
+template <typename Key, typename Value>
+ParentlessAVLTree<Key, Value>::~ParentlessAVLTree()
+{
+    clear();
+}
+
+template <typename Key, typename Value>
+bool ParentlessAVLTree<Key, Value>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template <typename Key, typename Value>
+size_t ParentlessAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+/**
+ * Points the child slot that path entry i leads through at child, or the
+ * root when i is -1.
+ */
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::attach(const Path &path, int i, PNode *child)
+{
+    if (i < 0)
+    {
+        root_ = child;
+    }
+    else if (path.wentLeft_[i])
+    {
+        path.nodes_[i]->left_ = child;
+    }
+    else
+    {
+        path.nodes_[i]->right_ = child;
+    }
+}
+
+// returns the new subtree root; the caller relinks it
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::PNode *ParentlessAVLTree<Key, Value>::rotateLeft(PNode *n)
+{
+    PNode *r = n->right_;
+    n->right_ = r->left_;
+    r->left_ = n;
+    return r;
+}
+
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::PNode *ParentlessAVLTree<Key, Value>::rotateRight(PNode *n)
+{
+    PNode *l = n->left_;
+    n->left_ = l->right_;
+    l->right_ = n;
+    return l;
+}
+
+/**
+ * Inserts the pair, or overwrites the value if the key is already there.
+ */
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    Path path;
+    PNode *curr = root_;
+    while (curr != nullptr)
+    {
+        if (keyValuePair.first < curr->item_.first)
+        {
+            path.push(curr, true);
+            curr = curr->left_;
+        }
+        else if (curr->item_.first < keyValuePair.first)
+        {
+            path.push(curr, false);
+            curr = curr->right_;
+        }
+        else
+        {
+            curr->item_.second = keyValuePair.second;
+            return;
+        }
+    }
+    attach(path, path.depth_ - 1, new PNode(keyValuePair.first, keyValuePair.second));
+    size_++;
+    insertFix(path);
+}
+
+/**
+ * Walks the recorded path bottom-up after a leaf was added below it, as
+ * AVLAlgorithms::insertFix does through parent pointers. At most one
+ * single or double rotation happens.
+ */
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::insertFix(Path &path)
+{
+    for (int i = path.depth_ - 1; i >= 0; i--)
+    {
+        PNode *p = path.nodes_[i];
+        int bal = p->balance_ + (path.wentLeft_[i] ? -1 : 1);
+        if (bal == 0)
+        {
+            p->balance_ = 0;
+            return;
+        }
+        if (bal == -1 || bal == 1)
+        {
+            p->balance_ = (int8_t)bal;
+            continue;
+        }
+        PNode *top;
+        if (bal == -2)
+        {
+            PNode *n = p->left_;
+            if (n->balance_ == -1)
+            {
+                // zig-zig
+                top = rotateRight(p);
+                p->balance_ = 0;
+                n->balance_ = 0;
+            }
+            else
+            {
+                // zig-zag
+                PNode *g = n->right_;
+                int gb = g->balance_;
+                p->left_ = rotateLeft(n);
+                top = rotateRight(p);
+                p->balance_ = (gb == -1) ? 1 : 0;
+                n->balance_ = (gb == 1) ? -1 : 0;
+                g->balance_ = 0;
+            }
+        }
+        else
+        {
+            PNode *n = p->right_;
+            if (n->balance_ == 1)
+            {
+                top = rotateLeft(p);
+                p->balance_ = 0;
+                n->balance_ = 0;
+            }
+            else
+            {
+                PNode *g = n->left_;
+                int gb = g->balance_;
+                p->right_ = rotateRight(n);
+                top = rotateLeft(p);
+                p->balance_ = (gb == 1) ? -1 : 0;
+                n->balance_ = (gb == -1) ? 1 : 0;
+                g->balance_ = 0;
+            }
+        }
+        attach(path, i - 1, top);
+        return;
+    }
+}
+
+/**
+ * Removes the key if present. A node with two children is replaced by its
+ * predecessor, as in avlbst.h; since the key is const the predecessor node
+ * is relinked into its place rather than having its contents swapped.
+ */
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::remove(const Key &key)
+{
+    Path path;
+    PNode *z = root_;
+    while (z != nullptr && (key < z->item_.first || z->item_.first < key))
+    {
+        bool left = key < z->item_.first;
+        path.push(z, left);
+        z = left ? z->left_ : z->right_;
+    }
+    if (z == nullptr)
+    {
+        return;
+    }
+
+    int zi = path.depth_;
+    if (z->left_ != nullptr && z->right_ != nullptr)
+    {
+        // extend the path down to the predecessor y
+        path.push(z, true);
+        PNode *y = z->left_;
+        while (y->right_ != nullptr)
+        {
+            path.push(y, false);
+            y = y->right_;
+        }
+        // unhook y, then put it where z was
+        attach(path, path.depth_ - 1, y->left_);
+        y->left_ = z->left_;
+        y->right_ = z->right_;
+        y->balance_ = z->balance_;
+        attach(path, zi - 1, y);
+        path.nodes_[zi] = y;
+    }
+    else
+    {
+        attach(path, zi - 1, (z->left_ != nullptr) ? z->left_ : z->right_);
+    }
+    delete z;
+    size_--;
+    removeFix(path, path.depth_ - 1);
+}
+
+/**
+ * Walks the path up from entry i after the side it leads through got
+ * shorter, continuing while subtree heights keep dropping.
+ */
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::removeFix(Path &path, int i)
+{
+    for (; i >= 0; i--)
+    {
+        PNode *n = path.nodes_[i];
+        int bal = n->balance_ + (path.wentLeft_[i] ? 1 : -1);
+        if (bal == -1 || bal == 1)
+        {
+            // height unchanged -- done
+            n->balance_ = (int8_t)bal;
+            return;
+        }
+        if (bal == 0)
+        {
+            n->balance_ = 0;
+            continue;
+        }
+        PNode *top;
+        bool shorter = true;
+        if (bal == 2)
+        {
+            PNode *c = n->right_;
+            int cb = c->balance_;
+            if (cb == 0)
+            {
+                top = rotateLeft(n);
+                n->balance_ = 1;
+                c->balance_ = -1;
+                shorter = false;
+            }
+            else if (cb == 1)
+            {
+                top = rotateLeft(n);
+                n->balance_ = 0;
+                c->balance_ = 0;
+            }
+            else
+            {
+                PNode *g = c->left_;
+                int gb = g->balance_;
+                n->right_ = rotateRight(c);
+                top = rotateLeft(n);
+                n->balance_ = (gb == 1) ? -1 : 0;
+                c->balance_ = (gb == -1) ? 1 : 0;
+                g->balance_ = 0;
+            }
+        }
+        else
+        {
+            PNode *c = n->left_;
+            int cb = c->balance_;
+            if (cb == 0)
+            {
+                top = rotateRight(n);
+                n->balance_ = -1;
+                c->balance_ = 1;
+                shorter = false;
+            }
+            else if (cb == -1)
+            {
+                top = rotateRight(n);
+                n->balance_ = 0;
+                c->balance_ = 0;
+            }
+            else
+            {
+                PNode *g = c->right_;
+                int gb = g->balance_;
+                n->left_ = rotateLeft(c);
+                top = rotateRight(n);
+                n->balance_ = (gb == -1) ? 1 : 0;
+                c->balance_ = (gb == 1) ? -1 : 0;
+                g->balance_ = 0;
+            }
+        }
+        attach(path, i - 1, top);
+        if (!shorter)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Frees every node in O(n) with no stack: rotate left children up to the
+ * root until it has none, then free the root and continue with its right.
+ */
+template <typename Key, typename Value>
+void ParentlessAVLTree<Key, Value>::clear()
+{
+    PNode *curr = root_;
+    while (curr != nullptr)
+    {
+        if (curr->left_ != nullptr)
+        {
+            curr = rotateRight(curr);
+        }
+        else
+        {
+            PNode *next = curr->right_;
+            delete curr;
+            curr = next;
+        }
+    }
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::PNode *ParentlessAVLTree<Key, Value>::internalFind(const Key &key) const
+{
+    PNode *curr = root_;
+    while (curr != nullptr)
+    {
+        if (key < curr->item_.first)
+        {
+            curr = curr->left_;
+        }
+        else if (curr->item_.first < key)
+        {
+            curr = curr->right_;
+        }
+        else
+        {
+            return curr;
+        }
+    }
+    return nullptr;
+}
+
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::iterator ParentlessAVLTree<Key, Value>::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::iterator ParentlessAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+ * Records only the ancestors we go left from, which are the ones a later
+ * ++ has to come back to.
+ */
+template <typename Key, typename Value>
+typename ParentlessAVLTree<Key, Value>::iterator ParentlessAVLTree<Key, Value>::find(const Key &key) const
+{
+    iterator it;
+    PNode *curr = root_;
+    while (curr != nullptr)
+    {
+        if (key < curr->item_.first)
+        {
+            it.stack_[it.depth_++] = curr;
+            curr = curr->left_;
+        }
+        else if (curr->item_.first < key)
+        {
+            curr = curr->right_;
+        }
+        else
+        {
+            it.stack_[it.depth_++] = curr;
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <typename Key, typename Value>
+Value &ParentlessAVLTree<Key, Value>::operator[](const Key &key)
+{
+    PNode *n = internalFind(key);
+    if (n == nullptr) throw std::out_of_range("Invalid key");
+    return n->item_.second;
+}
+
+template <typename Key, typename Value>
+Value const &ParentlessAVLTree<Key, Value>::operator[](const Key &key) const
+{
+    PNode *n = internalFind(key);
+    if (n == nullptr) throw std::out_of_range("Invalid key");
+    return n->item_.second;
+}
+
+#endif
@@ -0,0 +1,811 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+/**
+ * Asymptotic scaling check for the public operations of BinarySearchTree
+ * and AVLTree. Each operation runs at every power of two from 2^6 to
+ * 2^16 items on a tree built from shuffled keys, and two costs per call
+ * are each fitted to O(1), O(log n), O(n), O(n log n) and O(n^2) by least
+ * squares on the logarithms:
+ *   comparisons  key comparisons, counted exactly by the key type, so
+ *                this fit has no noise; anything that searches the tree
+ *                more than it should shows here
+ *   time         the best of several trials, divided by the time of one
+ *                in-order iterator step on the same tree. Larger trees
+ *                fall out of faster caches, which alone would make O(n)
+ *                look like O(n log n); the step cost rises the same way.
+ *                This catches the work that compares no keys, like a
+ *                clear() or isBalanced() that has turned quadratic.
+ * An operation fails when either fit grows faster than the bound it is
+ * held to. Telling O(n) from O(n log n) by time alone is at the edge of
+ * what the noise allows, which is why searches are also counted.
+ *
+ * With a results file, one CSV row per operation and size is appended:
+ *   label,structure,op,bound,compare_fit,time_fit,size,comparisons_per_call,ns_per_call
+ * Before appending, each operation's time is compared with the newest
+ * earlier label in the file, as a geometric mean over the sizes. A
+ * change of 1.5x either way is flagged, but does not fail the run.
+ *
+ * Usage: ./scaling-test [resultsFile] [label]
+ * The exit status is 1 if any operation fails.
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static const int MIN_LOG_SIZE = 6;
+static const int MAX_LOG_SIZE = 16;
+// the minimum over trials is kept; at least this many, and at least
+// MIN_TRIAL_MS of timed work in all
+static const int MIN_TRIALS = 5;
+static const double MIN_TRIAL_MS = 4.0;
+
+enum Complexity
+{
+    O_1,
+    O_LOG_N,
+    O_N,
+    O_N_LOG_N,
+    O_N2
+};
+
+static const char* const COMPLEXITY_NAMES[] = {"O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)"};
+
+static double model(Complexity c, double n)
+{
+    switch(c) {
+    case O_1:
+        return 1.0;
+    case O_LOG_N:
+        return std::log2(n);
+    case O_N:
+        return n;
+    case O_N_LOG_N:
+        return n * std::log2(n);
+    default:
+        return n * n;
+    }
+}
+
+/**
+ * The model whose shape, scaled by the best constant, leaves the least
+ * squared error in log space.
+ */
+static Complexity fitComplexity(const vector<double>& sizes, const vector<double>& costs)
+{
+    Complexity best = O_1;
+    double bestError = 0;
+    for(int c = O_1; c <= O_N2; c++) {
+        double mean = 0;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            mean += std::log(costs[i]) - std::log(model((Complexity)c, sizes[i]));
+        }
+        mean /= sizes.size();
+        double error = 0;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            double residual = std::log(costs[i]) - std::log(model((Complexity)c, sizes[i])) - mean;
+            error += residual * residual;
+        }
+        if(c == O_1 || error < bestError) {
+            best = (Complexity)c;
+            bestError = error;
+        }
+    }
+    return best;
+}
+
+// keep the compiler from hoisting tree reads out of the timed loops
+#if defined(__GNUC__) || defined(__clang__)
+#define SCALING_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define SCALING_BARRIER()
+#endif
+
+/**
+ * An int key that counts every comparison made on it.
+ */
+struct CountedKey
+{
+    static unsigned long long comparisons;
+    int value;
+
+    CountedKey() : value(0) {}
+    CountedKey(int v) : value(v) {}
+
+    bool operator<(const CountedKey& other) const
+    {
+        comparisons++;
+        return value < other.value;
+    }
+    bool operator>(const CountedKey& other) const
+    {
+        comparisons++;
+        return value > other.value;
+    }
+    bool operator==(const CountedKey& other) const
+    {
+        comparisons++;
+        return value == other.value;
+    }
+    bool operator!=(const CountedKey& other) const
+    {
+        comparisons++;
+        return value != other.value;
+    }
+};
+
+unsigned long long CountedKey::comparisons = 0;
+
+// for the tree printer
+std::ostream& operator<<(std::ostream& out, const CountedKey& key)
+{
+    return out << key.value;
+}
+
+/**
+ * State shared by the operations at one size: a tree holding the even
+ * keys 0, 2, ..., 2n-2 (inserted shuffled), and odd keys that are not in
+ * it. Operations that change the tree put it back untimed.
+ */
+template <typename Tree>
+struct Fixture
+{
+    Tree tree;
+    size_t n;
+    // keys in the tree, shuffled; the first calls() of them are used
+    vector<CountedKey> keys;
+    // keys not in the tree
+    vector<CountedKey> fresh;
+    vector<typename Tree::iterator> its;
+    long long sink;
+
+    explicit Fixture(size_t size, std::mt19937& rng) : n(size), keys(size), fresh(size), sink(0)
+    {
+        for(size_t i = 0; i < n; i++) {
+            keys[i] = (int)(2 * i);
+            fresh[i] = (int)(2 * i + 1);
+        }
+        std::shuffle(keys.begin(), keys.end(), rng);
+        std::shuffle(fresh.begin(), fresh.end(), rng);
+        rebuild();
+    }
+
+    void rebuild()
+    {
+        tree.clear();
+        for(size_t i = 0; i < n; i++) {
+            tree.insert(std::make_pair(keys[i], (int)i));
+        }
+    }
+
+    // calls per timed batch for per-call operations: few enough not to
+    // change the tree's size much
+    size_t batch() const
+    {
+        return std::max((size_t)1, std::min((size_t)256, n / 4));
+    }
+};
+
+/*
+ * One struct per operation:
+ *   name()              label in the output
+ *   bound()             the growth the cost per call must not exceed
+ *   calls(f)            calls one run() makes
+ *   setup(f), run(f), restore(f)
+ *                       run() is timed; setup() and restore() are not,
+ *                       and leave the fixture as they found it
+ */
+
+template <typename Tree>
+struct InsertOp
+{
+    static const char* name() { return "insert"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.insert(std::make_pair(f.fresh[i], 0));
+        }
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.remove(f.fresh[i]);
+        }
+    }
+};
+
+template <typename Tree>
+struct RemoveOp
+{
+    static const char* name() { return "remove"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.remove(f.keys[i]);
+        }
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.insert(std::make_pair(f.keys[i], 0));
+        }
+    }
+};
+
+template <typename Tree>
+struct EraseOp
+{
+    static const char* name() { return "erase(iterator)"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>& f)
+    {
+        f.its.clear();
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.its.push_back(f.tree.find(f.keys[i]));
+        }
+    }
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.its.size(); i++) {
+            f.tree.erase(f.its[i]);
+        }
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        RemoveOp<Tree>::restore(f);
+    }
+};
+
+template <typename Tree>
+struct ExtractInsertOp
+{
+    static const char* name() { return "extract+insert(node)"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.insert(f.tree.extract(f.keys[i]));
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct FindOp
+{
+    static const char* name() { return "find"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.sink += (f.tree.find(f.keys[i]) != f.tree.end());
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct IndexOp
+{
+    static const char* name() { return "operator[]"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.sink += f.tree[f.keys[i]];
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct CountOp
+{
+    static const char* name() { return "count"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.sink += f.tree.count(f.keys[i]);
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct EqualRangeOp
+{
+    static const char* name() { return "equal_range"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.sink += (f.tree.equal_range(f.keys[i]).first != f.tree.end());
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct FindManyOp
+{
+    static const char* name() { return "find_many"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        vector<CountedKey> batch(f.keys.begin(), f.keys.begin() + f.batch());
+        f.its.clear();
+        f.tree.find_many(batch, f.its);
+        f.sink += f.its.size();
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct PopMinOp
+{
+    static const char* name() { return "pop_min"; }
+    static Complexity bound() { return O_LOG_N; }
+    static size_t calls(Fixture<Tree>& f) { return f.batch(); }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.pop_min();
+        }
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        // the smallest keys are 0, 2, 4, ...
+        for(size_t i = 0; i < f.batch(); i++) {
+            f.tree.insert(std::make_pair((int)(2 * i), 0));
+        }
+    }
+};
+
+// O(1) accessors, called the same number of times at every size
+template <typename Tree>
+struct EndpointsOp
+{
+    static const char* name() { return "min/max/peek"; }
+    static Complexity bound() { return O_1; }
+    static size_t calls(Fixture<Tree>&) { return 3 * 256; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < 256; i++) {
+            f.sink += f.tree.min().second + f.tree.max().second + f.tree.peek().second;
+            SCALING_BARRIER();
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct SizeOp
+{
+    static const char* name() { return "size/empty/begin"; }
+    static Complexity bound() { return O_1; }
+    static size_t calls(Fixture<Tree>&) { return 3 * 256; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < 256; i++) {
+            f.sink += f.tree.size() + f.tree.empty() + f.tree.begin()->second;
+            SCALING_BARRIER();
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct IterateOp
+{
+    static const char* name() { return "iterator ++"; }
+    static Complexity bound() { return O_1; }
+    static size_t calls(Fixture<Tree>& f) { return f.n; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(typename Tree::iterator it = f.tree.begin(); it != f.tree.end(); ++it) {
+            f.sink += it->second;
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct ReverseIterateOp
+{
+    static const char* name() { return "reverse_iterator ++"; }
+    static Complexity bound() { return O_1; }
+    static size_t calls(Fixture<Tree>& f) { return f.n; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        for(typename Tree::reverse_iterator it = f.tree.rbegin(); it != f.tree.rend(); ++it) {
+            f.sink += it->second;
+        }
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+// whole-tree operations, one call per run
+
+template <typename Tree>
+struct ClearOp
+{
+    static const char* name() { return "clear"; }
+    static Complexity bound() { return O_N; }
+    static size_t calls(Fixture<Tree>&) { return 1; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        f.tree.clear();
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        f.rebuild();
+    }
+};
+
+template <typename Tree>
+struct IsBalancedOp
+{
+    static const char* name() { return "isBalanced"; }
+    static Complexity bound() { return O_N; }
+    static size_t calls(Fixture<Tree>&) { return 1; }
+    // a shuffled unbalanced tree fails the check near the bottom and
+    // returns early; a balanced one is walked in full
+    static void setup(Fixture<Tree>& f)
+    {
+        f.tree.rebalance();
+    }
+    static void run(Fixture<Tree>& f)
+    {
+        f.sink += f.tree.isBalanced();
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct RebalanceOp
+{
+    static const char* name() { return "rebalance"; }
+    static Complexity bound() { return O_N; }
+    static size_t calls(Fixture<Tree>&) { return 1; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        f.tree.rebalance();
+    }
+    static void restore(Fixture<Tree>&) {}
+};
+
+template <typename Tree>
+struct AssignSortedOp
+{
+    static const char* name() { return "assignSorted"; }
+    static Complexity bound() { return O_N; }
+    static size_t calls(Fixture<Tree>&) { return 1; }
+    static vector<std::pair<CountedKey, int> >& items()
+    {
+        static vector<std::pair<CountedKey, int> > sorted;
+        return sorted;
+    }
+    static void setup(Fixture<Tree>& f)
+    {
+        items().resize(f.n);
+        for(size_t i = 0; i < f.n; i++) {
+            items()[i] = std::make_pair(CountedKey((int)(2 * i)), 0);
+        }
+    }
+    static void run(Fixture<Tree>& f)
+    {
+        f.tree.assignSorted(items().begin(), items().size());
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        f.rebuild();
+    }
+};
+
+template <typename Tree>
+struct SaveLoadOp
+{
+    static const char* name() { return "save+load"; }
+    static Complexity bound() { return O_N; }
+    static size_t calls(Fixture<Tree>&) { return 1; }
+    static void setup(Fixture<Tree>&) {}
+    static void run(Fixture<Tree>& f)
+    {
+        f.tree.save("scaling-test.snap");
+        f.tree.load("scaling-test.snap");
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        std::remove("scaling-test.snap");
+        f.rebuild();
+    }
+};
+
+template <typename Tree>
+struct MergeOp
+{
+    static const char* name() { return "merge"; }
+    static Complexity bound() { return O_N_LOG_N; }
+    static size_t calls(Fixture<Tree>&) { return 1; }
+    static Tree& other()
+    {
+        static Tree tree;
+        return tree;
+    }
+    static void setup(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.n; i++) {
+            other().insert(std::make_pair(f.fresh[i], 0));
+        }
+    }
+    static void run(Fixture<Tree>& f)
+    {
+        f.tree.merge(other());
+    }
+    static void restore(Fixture<Tree>& f)
+    {
+        for(size_t i = 0; i < f.n; i++) {
+            f.tree.remove(f.fresh[i]);
+        }
+    }
+};
+
+/**
+ * Results of one operation on one structure.
+ */
+struct Result
+{
+    string structure;
+    string op;
+    Complexity bound;
+    Complexity compareFit;
+    Complexity timeFit;
+    vector<double> sizes;
+    vector<double> comparisons;
+    vector<double> ns;
+
+    bool failed() const
+    {
+        return compareFit > bound || timeFit > bound;
+    }
+};
+
+/**
+ * The best time per call over the trials, and the comparisons per call
+ * (the same in every trial).
+ */
+template <typename Op, typename Tree>
+static double timeOp(Fixture<Tree>& f, double& comparisons)
+{
+    double best = 1e30;
+    double spent = 0;
+    for(int trial = 0; trial < MIN_TRIALS || spent < MIN_TRIAL_MS * 1e6; trial++) {
+        Op::setup(f);
+        CountedKey::comparisons = 0;
+        Clock::time_point start = Clock::now();
+        Op::run(f);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        comparisons = (double)CountedKey::comparisons / Op::calls(f);
+        Op::restore(f);
+        spent += ns;
+        best = std::min(best, ns / Op::calls(f));
+    }
+    return best;
+}
+
+template <typename Op, typename Tree>
+static void runOp(const char* structure, vector<Result>& results)
+{
+    Result result;
+    result.structure = structure;
+    result.op = Op::name();
+    result.bound = Op::bound();
+    // a cost of zero has no logarithm, so one is added to every count
+    vector<double> counted;
+    vector<double> normalised;
+    std::mt19937 rng(48);
+    for(int logSize = MIN_LOG_SIZE; logSize <= MAX_LOG_SIZE; logSize++) {
+        size_t n = (size_t)1 << logSize;
+        Fixture<Tree> f(n, rng);
+        double unused;
+        double step = timeOp<IterateOp<Tree> >(f, unused);
+        double comparisons;
+        double ns = timeOp<Op>(f, comparisons);
+        result.sizes.push_back((double)n);
+        result.comparisons.push_back(comparisons);
+        result.ns.push_back(ns);
+        counted.push_back(comparisons + 1);
+        normalised.push_back(ns / step);
+        if(f.sink == 42) {
+            cout << "#" << endl;
+        }
+    }
+    result.compareFit = fitComplexity(result.sizes, counted);
+    result.timeFit = fitComplexity(result.sizes, normalised);
+    results.push_back(result);
+}
+
+template <typename Tree>
+static void runStructure(const char* structure, vector<Result>& results)
+{
+    runOp<InsertOp<Tree>, Tree>(structure, results);
+    runOp<RemoveOp<Tree>, Tree>(structure, results);
+    runOp<EraseOp<Tree>, Tree>(structure, results);
+    runOp<ExtractInsertOp<Tree>, Tree>(structure, results);
+    runOp<FindOp<Tree>, Tree>(structure, results);
+    runOp<IndexOp<Tree>, Tree>(structure, results);
+    runOp<CountOp<Tree>, Tree>(structure, results);
+    runOp<EqualRangeOp<Tree>, Tree>(structure, results);
+    runOp<FindManyOp<Tree>, Tree>(structure, results);
+    runOp<PopMinOp<Tree>, Tree>(structure, results);
+    runOp<EndpointsOp<Tree>, Tree>(structure, results);
+    runOp<SizeOp<Tree>, Tree>(structure, results);
+    runOp<IterateOp<Tree>, Tree>(structure, results);
+    runOp<ReverseIterateOp<Tree>, Tree>(structure, results);
+    runOp<ClearOp<Tree>, Tree>(structure, results);
+    runOp<IsBalancedOp<Tree>, Tree>(structure, results);
+    runOp<RebalanceOp<Tree>, Tree>(structure, results);
+    runOp<AssignSortedOp<Tree>, Tree>(structure, results);
+    runOp<SaveLoadOp<Tree>, Tree>(structure, results);
+    runOp<MergeOp<Tree>, Tree>(structure, results);
+}
+
+/**
+ * Reads the times of the newest label other than this one, keyed by
+ * "structure,op" and then size, and returns that label.
+ */
+static string readPrevious(const string& path, const string& label, map<string, map<double, double> >& previous)
+{
+    ifstream in(path.c_str());
+    vector<string> rows;
+    string line;
+    string newest;
+    while(std::getline(in, line)) {
+        string rowLabel = line.substr(0, line.find(','));
+        if(rowLabel != label && rowLabel != "label" && !rowLabel.empty()) {
+            newest = rowLabel;
+        }
+        rows.push_back(line);
+    }
+    for(size_t i = 0; i < rows.size(); i++) {
+        // label,structure,op,bound,compare_fit,time_fit,size,comparisons_per_call,ns_per_call
+        vector<string> fields;
+        stringstream row(rows[i]);
+        string field;
+        while(std::getline(row, field, ',')) {
+            fields.push_back(field);
+        }
+        if(fields.size() == 9 && fields[0] == newest) {
+            previous[fields[1] + "," + fields[2]][atof(fields[6].c_str())] = atof(fields[8].c_str());
+        }
+    }
+    return newest;
+}
+
+/**
+ * "1.07x" for the geometric mean ratio of this run's times to the
+ * previous ones at the sizes both have, with " CHANGED" past 1.5x either
+ * way; empty when there is nothing to compare with.
+ */
+static string compareTimes(const Result& r, const map<string, map<double, double> >& previous)
+{
+    map<string, map<double, double> >::const_iterator old = previous.find(r.structure + "," + r.op);
+    if(old == previous.end()) {
+        return "";
+    }
+    double logRatio = 0;
+    int matched = 0;
+    for(size_t i = 0; i < r.sizes.size(); i++) {
+        map<double, double>::const_iterator at = old->second.find(r.sizes[i]);
+        if(at != old->second.end() && at->second > 0) {
+            logRatio += std::log(r.ns[i] / at->second);
+            matched++;
+        }
+    }
+    if(matched == 0) {
+        return "";
+    }
+    double ratio = std::exp(logRatio / matched);
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.2fx%s", ratio, (ratio > 1.5 || ratio < 1 / 1.5) ? " CHANGED" : "");
+    return buffer;
+}
+
+int main(int argc, char* argv[])
+{
+    string resultsPath;
+    string label = "current";
+    if(argc > 1) {
+        resultsPath = argv[1];
+    }
+    if(argc > 2) {
+        label = argv[2];
+    }
+
+    vector<Result> results;
+    runStructure<BinarySearchTree<CountedKey, int> >("BinarySearchTree", results);
+    runStructure<AVLTree<CountedKey, int> >("AVLTree", results);
+
+    map<string, map<double, double> > previous;
+    string previousLabel;
+    if(!resultsPath.empty()) {
+        previousLabel = readPrevious(resultsPath, label, previous);
+    }
+
+    int failures = 0;
+    printf("%-17s %-21s %-11s %-11s %-11s %10s %10s %10s  %s\n", "structure", "operation", "bound",
+           "compares", "time", "cmp@max", "ns@min", "ns@max", previousLabel.empty() ? "" : ("vs " + previousLabel).c_str());
+    for(size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        failures += r.failed();
+        printf("%-17s %-21s %-11s %-11s %-11s %10.1f %10.1f %10.1f  %s%s\n", r.structure.c_str(), r.op.c_str(),
+               COMPLEXITY_NAMES[r.bound], COMPLEXITY_NAMES[r.compareFit], COMPLEXITY_NAMES[r.timeFit],
+               r.comparisons.back(), r.ns.front(), r.ns.back(), compareTimes(r, previous).c_str(),
+               r.failed() ? " FAIL" : "");
+    }
+
+    if(!resultsPath.empty()) {
+        ifstream probe(resultsPath.c_str());
+        bool fresh = !probe.good();
+        probe.close();
+        ofstream out(resultsPath.c_str(), std::ios::app);
+        if(fresh) {
+            out << "label,structure,op,bound,compare_fit,time_fit,size,comparisons_per_call,ns_per_call" << endl;
+        }
+        for(size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            for(size_t j = 0; j < r.sizes.size(); j++) {
+                out << label << "," << r.structure << "," << r.op << "," << COMPLEXITY_NAMES[r.bound] << ","
+                    << COMPLEXITY_NAMES[r.compareFit] << "," << COMPLEXITY_NAMES[r.timeFit] << ","
+                    << (size_t)r.sizes[j] << "," << r.comparisons[j] << "," << r.ns[j] << endl;
+            }
+        }
+    }
+
+    if(failures == 0) {
+        cout << "all operations within their bounds" << endl;
+        return 0;
+    }
+    cout << failures << " operations over their bounds" << endl;
+    return 1;
+}
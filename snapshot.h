@@ -0,0 +1,412 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * On-disk layout of a tree snapshot (see BinarySearchTree::save()):
+ *   SnapshotHeader, then count records in key order, each the key's
+ *   encoding followed by the value's.
+ * Raw-byte codecs write native byte order, so snapshots are meant to be
+ * read back on the machine type that wrote them.
+ */
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;   // sizeof(Key) of the writer, as a sanity check
+    uint32_t valueSize; // sizeof(Value) of the writer
+    uint32_t epoch;     // checkpoint epoch covered (DurableAVLTree), else 0
+    uint64_t count;
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'B', 'S', 'T', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+// large enough that the disk, not the call overhead, sets the pace
+static const size_t SNAPSHOT_BUFFER_BYTES = 1 << 20;
+
+/**
+ * fsyncs the directory holding path, so that a file just created or
+ * renamed there is itself on disk and not only its contents.
+ */
+inline void syncParentDirectory(const std::string &path)
+{
+    std::string::size_type slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    bool synced = (fd >= 0 && ::fsync(fd) == 0);
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    if (!synced)
+    {
+        throw std::runtime_error("Cannot sync directory " + dir);
+    }
+}
+
+// a name next to path, unique to this process, to write a file under
+// before publishFile() moves it into place
+inline std::string snapshotTempPath(const std::string &path)
+{
+    return path + ".tmp." + std::to_string((long)::getpid());
+}
+
+/**
+ * fsyncs temp, renames it over path and syncs the directory, so readers
+ * see the old file or the new one whole and a crash cannot undo the
+ * rename. On failure temp is removed and path left as it was.
+ */
+inline void publishFile(const std::string &temp, const std::string &path)
+{
+    int fd = ::open(temp.c_str(), O_RDONLY);
+    bool synced = (fd >= 0 && ::fsync(fd) == 0);
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    if (!synced || std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Cannot write " + path);
+    }
+    syncParentDirectory(path);
+}
+
+// rewrites the header of an existing snapshot in place, e.g. to fill in
+// a count only known once every record is out
+inline void writeSnapshotHeader(const std::string &path, const SnapshotHeader &header);
+inline SnapshotHeader readSnapshotHeader(const std::string &path);
+
+/**
+ * Buffered binary file output. Errors throw std::runtime_error.
+ */
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(const std::string &path);
+    ~SnapshotWriter();
+
+    void write(const void *data, size_t bytes);
+    // flushes and closes; the destructor does the same but cannot report
+    // a failure, so call this to know the file is complete
+    void close();
+
+protected:
+    void flush();
+
+    std::FILE *file_;
+    std::vector<char> buffer_;
+    size_t used_;
+
+private:
+    SnapshotWriter(const SnapshotWriter &);
+    SnapshotWriter &operator=(const SnapshotWriter &);
+};
+
+/**
+ * Buffered binary file input. A short read throws std::runtime_error.
+ */
+class SnapshotReader
+{
+public:
+    // a smaller buffer suits many files read at once, as in a merge
+    explicit SnapshotReader(const std::string &path, size_t bufferBytes = SNAPSHOT_BUFFER_BYTES);
+    ~SnapshotReader();
+
+    void read(void *data, size_t bytes);
+    // true once every byte of the file has been read
+    bool atEnd();
+    // bytes not yet read, as of when the file was opened
+    uint64_t remaining() const;
+
+protected:
+    std::FILE *file_;
+    std::vector<char> buffer_;
+    size_t pos_;
+    size_t end_;
+    uint64_t fileBytes_;
+    // bytes fread() into buffer_ so far
+    uint64_t filled_;
+
+private:
+    SnapshotReader(const SnapshotReader &);
+    SnapshotReader &operator=(const SnapshotReader &);
+};
+
+/**
+ * Byte streams over memory, for encoding single records (the write-ahead
+ * log frames and checksums each one). BufferReader throws
+ * std::runtime_error when a read runs past the end.
+ */
+class BufferWriter
+{
+public:
+    void write(const void *data, size_t bytes);
+
+    std::vector<char> bytes_;
+};
+
+class BufferReader
+{
+public:
+    BufferReader(const char *data, size_t bytes);
+
+    void read(void *data, size_t bytes);
+    uint64_t remaining() const;
+
+protected:
+    const char *pos_;
+    const char *end_;
+};
+
+/**
+ * How one key or value type is written. The default copies the raw
+ * bytes and only compiles for trivially copyable types; specialise it
+ * (as done for std::string below), or pass another codec with the same
+ * two functions to save()/load(), for anything else. Out and In are any
+ * stream with write(const void*, size_t) / read(void*, size_t), such as
+ * the file and buffer streams here; the std::string codec also asks In
+ * for remaining(), the bytes left to read.
+ */
+template <typename T>
+struct SnapshotCodec
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SnapshotCodec needs a specialisation for this type");
+
+    template <typename Out>
+    static void write(Out &out, const T &item)
+    {
+        out.write(&item, sizeof(T));
+    }
+    template <typename In>
+    static void read(In &in, T &item)
+    {
+        in.read(&item, sizeof(T));
+    }
+};
+
+// length-prefixed bytes
+template <>
+struct SnapshotCodec<std::string>
+{
+    template <typename Out>
+    static void write(Out &out, const std::string &item)
+    {
+        uint64_t length = item.size();
+        out.write(&length, sizeof(length));
+        out.write(item.data(), item.size());
+    }
+    template <typename In>
+    static void read(In &in, std::string &item)
+    {
+        uint64_t length;
+        in.read(&length, sizeof(length));
+        // a corrupt length must not become a huge allocation
+        if (length > in.remaining())
+        {
+            throw std::runtime_error("String length runs past the end of the data");
+        }
+        item.resize(length);
+        if (length > 0)
+        {
+            in.read(&item[0], length);
+        }
+    }
+};
+
+/*
+-----------------------------------------------
+Begin implementations for the snapshot streams.
+-----------------------------------------------
+*/
+
+inline SnapshotWriter::SnapshotWriter(const std::string &path) : buffer_(SNAPSHOT_BUFFER_BYTES), used_(0)
+{
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == NULL)
+    {
+        throw std::runtime_error("Cannot open " + path + " for writing");
+    }
+}
+
+inline SnapshotWriter::~SnapshotWriter()
+{
+    if (file_ != NULL)
+    {
+        // best effort -- close() is the checked path
+        std::fwrite(&buffer_[0], 1, used_, file_);
+        std::fclose(file_);
+    }
+}
+
+inline void SnapshotWriter::flush()
+{
+    if (used_ > 0 && std::fwrite(&buffer_[0], 1, used_, file_) != used_)
+    {
+        throw std::runtime_error("Snapshot write failed");
+    }
+    used_ = 0;
+}
+
+inline void SnapshotWriter::write(const void *data, size_t bytes)
+{
+    const char *src = static_cast<const char *>(data);
+    while (bytes > 0)
+    {
+        if (used_ == buffer_.size())
+        {
+            flush();
+        }
+        size_t chunk = std::min(bytes, buffer_.size() - used_);
+        std::memcpy(&buffer_[used_], src, chunk);
+        used_ += chunk;
+        src += chunk;
+        bytes -= chunk;
+    }
+}
+
+inline void SnapshotWriter::close()
+{
+    if (file_ == NULL)
+    {
+        return;
+    }
+    flush();
+    std::FILE *file = file_;
+    file_ = NULL;
+    if (std::fclose(file) != 0)
+    {
+        throw std::runtime_error("Snapshot write failed");
+    }
+}
+
+inline SnapshotReader::SnapshotReader(const std::string &path, size_t bufferBytes)
+    : buffer_(std::max(bufferBytes, (size_t)1)), pos_(0), end_(0), fileBytes_(0), filled_(0)
+{
+    file_ = std::fopen(path.c_str(), "rb");
+    if (file_ == NULL)
+    {
+        throw std::runtime_error("Cannot open " + path + " for reading");
+    }
+    long bytes = -1;
+    if (std::fseek(file_, 0, SEEK_END) == 0)
+    {
+        bytes = std::ftell(file_);
+    }
+    if (bytes < 0 || std::fseek(file_, 0, SEEK_SET) != 0)
+    {
+        std::fclose(file_);
+        throw std::runtime_error("Cannot open " + path + " for reading");
+    }
+    fileBytes_ = (uint64_t)bytes;
+}
+
+inline SnapshotReader::~SnapshotReader()
+{
+    std::fclose(file_);
+}
+
+inline void SnapshotReader::read(void *data, size_t bytes)
+{
+    char *dst = static_cast<char *>(data);
+    while (bytes > 0)
+    {
+        if (pos_ == end_)
+        {
+            end_ = std::fread(&buffer_[0], 1, buffer_.size(), file_);
+            pos_ = 0;
+            filled_ += end_;
+            if (end_ == 0)
+            {
+                throw std::runtime_error("Snapshot is truncated");
+            }
+        }
+        size_t chunk = std::min(bytes, end_ - pos_);
+        std::memcpy(dst, &buffer_[pos_], chunk);
+        pos_ += chunk;
+        dst += chunk;
+        bytes -= chunk;
+    }
+}
+
+inline void writeSnapshotHeader(const std::string &path, const SnapshotHeader &header)
+{
+    std::FILE *file = std::fopen(path.c_str(), "r+b");
+    if (file == NULL)
+    {
+        throw std::runtime_error("Cannot open " + path + " for writing");
+    }
+    bool written = (std::fwrite(&header, sizeof(header), 1, file) == 1);
+    if (std::fclose(file) != 0 || !written)
+    {
+        throw std::runtime_error("Snapshot write failed");
+    }
+}
+
+inline SnapshotHeader readSnapshotHeader(const std::string &path)
+{
+    SnapshotHeader header;
+    SnapshotReader in(path);
+    in.read(&header, sizeof(header));
+    return header;
+}
+
+inline bool SnapshotReader::atEnd()
+{
+    if (pos_ == end_)
+    {
+        end_ = std::fread(&buffer_[0], 1, buffer_.size(), file_);
+        pos_ = 0;
+        filled_ += end_;
+    }
+    return end_ == 0;
+}
+
+/**
+ * A file that grew after opening reads as its size then; one that shrank
+ * gives 0 once filled_ passes the old size.
+ */
+inline uint64_t SnapshotReader::remaining() const
+{
+    uint64_t unread = filled_ < fileBytes_ ? fileBytes_ - filled_ : 0;
+    return unread + (end_ - pos_);
+}
+
+inline void BufferWriter::write(const void *data, size_t bytes)
+{
+    const char *src = static_cast<const char *>(data);
+    bytes_.insert(bytes_.end(), src, src + bytes);
+}
+
+inline BufferReader::BufferReader(const char *data, size_t bytes) : pos_(data), end_(data + bytes)
+{
+}
+
+inline void BufferReader::read(void *data, size_t bytes)
+{
+    if ((size_t)(end_ - pos_) < bytes)
+    {
+        throw std::runtime_error("Record is truncated");
+    }
+    std::memcpy(data, pos_, bytes);
+    pos_ += bytes;
+}
+
+inline uint64_t BufferReader::remaining() const
+{
+    return (uint64_t)(end_ - pos_);
+}
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <ostream>
+#include <memory>
+#include "latency_histogram.h"
+
+/**
+ * Event counters and latency histograms for BinarySearchTree and the
+ * trees derived from it, chosen at compile time. By default the calls
+ * are empty inline functions on an empty base class, so they compile
+ * away and the tree stays the same size. Build with -DBST_STATS to
+ * count events, -DBST_LATENCY to time operations (either or both), or
+ * define BST_STATS_POLICY as another class with the same members. Every
+ * translation unit in a program must make the same choice.
+ *
+ * Both are charged to the public operation in progress:
+ *   insert      insert() (item or node handle)
+ *   remove      remove(), erase(), extract(), pop_/extract_ min and max
+ *   find        find(), count(), equal_range()
+ *   operator[]  both overloads
+ *   other       find_many() batches, and work outside any of these:
+ *               merge(), rebalance(), scapegoat rebuilds
+ * and within each operation the counters are
+ *   calls        times the operation was called
+ *   comparisons  key comparisons made while descending the tree
+ *   nodeVisits   nodes stepped onto while descending
+ *   rotations    AVL single rotations (a double rotation counts 2)
+ *   fixSteps     levels the AVL insertFix()/removeFix() loops climbed
+ *
+ * Latency is read from the time-stamp counter around a call and kept in
+ * one LatencyHistogram per operation, allocated on the first call (about
+ * 5 KB each); latency() reads back the count, mean, p50, p99, p99.9 and
+ * max of each. A timed call costs two counter reads and a bucket
+ * increment, 10-40 ns depending on how the machine virtualises the
+ * counter. To leave it on in production, -DBST_LATENCY_SAMPLE=16 (say)
+ * times only every 16th call of each operation, for a counter bump on
+ * the rest; the percentiles are then over the sample.
+ *
+ * With either on, lookups on a const tree write to the tree, so it must
+ * not be searched from several threads at once.
+ */
+
+enum TreeStatsOp
+{
+    TREE_STATS_INSERT,
+    TREE_STATS_REMOVE,
+    TREE_STATS_FIND,
+    TREE_STATS_INDEX,
+    TREE_STATS_OTHER,
+    TREE_STATS_OPS
+};
+
+inline const char* treeStatsOpName(TreeStatsOp op)
+{
+    static const char* const names[TREE_STATS_OPS] = {"insert", "remove", "find", "operator[]", "other"};
+    return names[op];
+}
+
+struct TreeOpStats
+{
+    unsigned long long calls;
+    unsigned long long comparisons;
+    unsigned long long nodeVisits;
+    unsigned long long rotations;
+    unsigned long long fixSteps;
+
+    TreeOpStats() : calls(0), comparisons(0), nodeVisits(0), rotations(0), fixSteps(0) {}
+};
+
+/**
+ * A copy of a tree's counters, one TreeOpStats per operation.
+ */
+struct TreeStats
+{
+    TreeOpStats ops[TREE_STATS_OPS];
+
+    const TreeOpStats& operator[](TreeStatsOp op) const
+    {
+        return ops[op];
+    }
+
+    // the counters summed over the operations
+    TreeOpStats total() const
+    {
+        TreeOpStats sum;
+        for (int op = 0; op < TREE_STATS_OPS; op++)
+        {
+            sum.calls += ops[op].calls;
+            sum.comparisons += ops[op].comparisons;
+            sum.nodeVisits += ops[op].nodeVisits;
+            sum.rotations += ops[op].rotations;
+            sum.fixSteps += ops[op].fixSteps;
+        }
+        return sum;
+    }
+};
+
+/**
+ * One line per operation that did anything:
+ *   find: 3 calls, 12 comparisons, 7 node visits, 0 rotations, 0 fix steps
+ */
+inline std::ostream& operator<<(std::ostream& out, const TreeStats& stats)
+{
+    for (int op = 0; op < TREE_STATS_OPS; op++)
+    {
+        const TreeOpStats& s = stats.ops[op];
+        if (s.calls == 0 && s.comparisons == 0 && s.nodeVisits == 0 && s.rotations == 0 && s.fixSteps == 0)
+        {
+            continue;
+        }
+        out << treeStatsOpName((TreeStatsOp)op) << ": " << s.calls << " calls, " << s.comparisons
+            << " comparisons, " << s.nodeVisits << " node visits, " << s.rotations << " rotations, "
+            << s.fixSteps << " fix steps" << std::endl;
+    }
+    return out;
+}
+
+/**
+ * The latency summary of each operation, in nanoseconds.
+ */
+struct TreeLatency
+{
+    LatencySummary ops[TREE_STATS_OPS];
+
+    const LatencySummary& operator[](TreeStatsOp op) const
+    {
+        return ops[op];
+    }
+};
+
+/**
+ * One line per operation that was timed:
+ *   find: 1000 calls, mean 52 ns, p50 48 ns, p99 110 ns, p99.9 900 ns, max 2400 ns
+ */
+inline std::ostream& operator<<(std::ostream& out, const TreeLatency& latency)
+{
+    for (int op = 0; op < TREE_STATS_OPS; op++)
+    {
+        const LatencySummary& s = latency.ops[op];
+        if (s.count == 0)
+        {
+            continue;
+        }
+        out << treeStatsOpName((TreeStatsOp)op) << ": " << s.count << " calls, mean " << s.meanNs
+            << " ns, p50 " << s.p50Ns << " ns, p99 " << s.p99Ns << " ns, p99.9 " << s.p999Ns
+            << " ns, max " << s.maxNs << " ns" << std::endl;
+    }
+    return out;
+}
+
+/**
+ * The default policy: counts nothing, and stats() and latency() are
+ * always zero.
+ */
+class NoTreeStats
+{
+public:
+    // marks the operation events are charged to while it is in scope
+    class Scope
+    {
+    public:
+        Scope(const NoTreeStats&, TreeStatsOp) {}
+    };
+
+    void countComparison() const {}
+    void countVisit() const {}
+    void countRotation() const {}
+    void countFixStep() const {}
+    TreeStats statsSnapshot() const { return TreeStats(); }
+    void statsReset() {}
+    TreeLatency latencySnapshot() const { return TreeLatency(); }
+    void latencyReset() {}
+};
+
+/**
+ * Counts every event, charged to the innermost operation in scope (so an
+ * insert inside merge() counts as an insert).
+ */
+class CountingTreeStats
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(const CountingTreeStats& stats, TreeStatsOp op) : stats_(stats), previous_(stats.current_)
+        {
+            stats_.current_ = op;
+            stats_.counts_.ops[op].calls++;
+        }
+        ~Scope()
+        {
+            stats_.current_ = previous_;
+        }
+
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+        const CountingTreeStats& stats_;
+        TreeStatsOp previous_;
+    };
+
+    CountingTreeStats() : current_(TREE_STATS_OTHER) {}
+
+    void countComparison() const { counts_.ops[current_].comparisons++; }
+    void countVisit() const { counts_.ops[current_].nodeVisits++; }
+    void countRotation() const { counts_.ops[current_].rotations++; }
+    void countFixStep() const { counts_.ops[current_].fixSteps++; }
+    TreeStats statsSnapshot() const { return counts_; }
+    void statsReset() { counts_ = TreeStats(); }
+    TreeLatency latencySnapshot() const { return TreeLatency(); }
+    void latencyReset() {}
+
+protected:
+    mutable TreeStats counts_;
+    mutable TreeStatsOp current_;
+};
+
+// with BST_LATENCY, one call in this many of each operation is timed
+#ifndef BST_LATENCY_SAMPLE
+#define BST_LATENCY_SAMPLE 1
+#endif
+
+/**
+ * Times each operation on top of another policy (NoTreeStats or
+ * CountingTreeStats), which goes on counting as before.
+ */
+template <typename Base>
+class LatencyTreeStats : public Base
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(const LatencyTreeStats& stats, TreeStatsOp op)
+            : inner_(stats, op), stats_(stats), op_(op), start_(stats.sampleNext(op) ? latencyTicks() : 0)
+        {
+        }
+        ~Scope()
+        {
+            // 0 marks a call left out of the sample
+            if (start_ != 0)
+            {
+                stats_.recordLatency(op_, latencyTicks() - start_);
+            }
+        }
+
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+        typename Base::Scope inner_;
+        const LatencyTreeStats& stats_;
+        TreeStatsOp op_;
+        uint64_t start_;
+    };
+
+    LatencyTreeStats()
+    {
+        std::fill(skipped_, skipped_ + TREE_STATS_OPS, 0u);
+    }
+
+    TreeLatency latencySnapshot() const
+    {
+        TreeLatency latency;
+        for (int op = 0; op < TREE_STATS_OPS && histograms_; op++)
+        {
+            latency.ops[op] = histograms_[op].summarize();
+        }
+        return latency;
+    }
+
+    void latencyReset()
+    {
+        histograms_.reset();
+    }
+
+protected:
+    bool sampleNext(TreeStatsOp op) const
+    {
+        return BST_LATENCY_SAMPLE == 1 || ++skipped_[op] % BST_LATENCY_SAMPLE == 0;
+    }
+
+    void recordLatency(TreeStatsOp op, uint64_t ticks) const
+    {
+        if (!histograms_)
+        {
+            histograms_.reset(new LatencyHistogram[TREE_STATS_OPS]);
+        }
+        histograms_[op].record(ticks);
+    }
+
+    mutable std::unique_ptr<LatencyHistogram[]> histograms_;
+    mutable unsigned skipped_[TREE_STATS_OPS];
+};
+
+#ifndef BST_STATS_POLICY
+#ifdef BST_STATS
+#define BST_COUNTING_POLICY CountingTreeStats
+#else
+#define BST_COUNTING_POLICY NoTreeStats
+#endif
+#ifdef BST_LATENCY
+#define BST_STATS_POLICY LatencyTreeStats<BST_COUNTING_POLICY>
+#else
+#define BST_STATS_POLICY BST_COUNTING_POLICY
+#endif
+#endif
+
+typedef BST_STATS_POLICY TreeStatsPolicy;
+
+#endif
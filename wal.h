@@ -0,0 +1,952 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "snapshot.h"
+#include "avlbst.h"
+#include "avlset.h"
+
+/**
+ * Write-ahead log file layout:
+ *   WALHeader, then records, each
+ *     uint32_t length;    bytes of payload
+ *     uint32_t checksum;  FNV-1a of the payload
+ *     payload:            uint8_t type, the key, and for WAL_INSERT the value
+ * A crash can leave the last record half written; replay() stops at the
+ * first record that is short or fails its checksum.
+ */
+struct WALHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t reserved;
+};
+
+static const char WAL_MAGIC[8] = {'B', 'S', 'T', 'W', 'A', 'L', '\0', '\0'};
+static const uint32_t WAL_VERSION = 1;
+
+/**
+ * A delta checkpoint is a SnapshotHeader with this magic and its epoch,
+ * then count entries in key order, each
+ *   uint8_t live;  0 for a tombstone (the key was removed)
+ *   the key, and for live entries the value
+ */
+static const char DELTA_MAGIC[8] = {'B', 'S', 'T', 'D', 'E', 'L', 'T', 'A'};
+
+enum WALRecordType
+{
+    WAL_INSERT = 1,
+    WAL_REMOVE = 2
+};
+
+/**
+ * Holds an exclusive flock() on a lock file for its lifetime, creating
+ * the file if needed. The lock belongs to the open file, so it also
+ * keeps out another FileLock on the same path in this process.
+ */
+class FileLock
+{
+public:
+    explicit FileLock(const std::string &path)
+    {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        while (::flock(fd_, LOCK_EX) != 0)
+        {
+            if (errno != EINTR)
+            {
+                ::close(fd_);
+                throw std::runtime_error("Cannot lock " + path);
+            }
+        }
+    }
+    ~FileLock()
+    {
+        // closing releases the lock
+        ::close(fd_);
+    }
+
+private:
+    FileLock(const FileLock &);
+    FileLock &operator=(const FileLock &);
+    int fd_;
+};
+
+/**
+ * Durability settings. Records are queued in memory and written out with
+ * one write() per group; every syncEvery-th group write is followed by an
+ * fsync(). A crash loses at most the unwritten group, plus whatever the
+ * OS had not put on disk since the last fsync.
+ *   groupSize 1, syncEvery 1   every mutation is on disk when it returns
+ *   groupSize N, syncEvery 1   group commit: one fsync per N mutations
+ *   syncEvery 0                never fsync; survives a process crash only
+ * commit() writes and syncs whatever is queued, whatever the settings.
+ */
+struct WALOptions
+{
+    size_t groupSize;
+    size_t syncEvery;
+
+    WALOptions(size_t groupSize = 1, size_t syncEvery = 1) : groupSize(groupSize), syncEvery(syncEvery) {}
+};
+
+/**
+ * Appends insert/remove records to a log file. Keys and values are
+ * encoded with the same codecs as snapshots. I/O errors throw
+ * std::runtime_error.
+ */
+template <typename Key, typename Value,
+          typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+class WriteAheadLog
+{
+public:
+    // opens (creating if needed) the log at path for appending; an
+    // existing file must already be cut back to whole records, which
+    // replay() reports
+    WriteAheadLog(const std::string &path, const WALOptions &options = WALOptions());
+    // writes out the queued records without syncing
+    ~WriteAheadLog();
+
+    void logInsert(const Key &key, const Value &value);
+    void logRemove(const Key &key);
+    // writes and fsyncs everything queued so far
+    void commit();
+    // empties the log, e.g. once a snapshot holds everything in it
+    void reset();
+
+    // Applies every whole record in the log at path to tree, in order.
+    // Returns the byte length of the valid prefix (0 if there is no
+    // file); anything after it is a torn write from a crash.
+    template <typename Tree>
+    static size_t replay(const std::string &path, Tree &tree);
+    // cuts the file at path back to validBytes, dropping a torn tail
+    static void truncate(const std::string &path, size_t validBytes);
+
+protected:
+    static uint32_t checksum(const char *data, size_t bytes);
+    static WALHeader makeHeader();
+    // encodes straight into pending_: reserve the frame, write the
+    // payload, then fill the frame in
+    size_t beginRecord(uint8_t type);
+    void endRecord(size_t start);
+    void writeOut();
+    void writeAll(const char *data, size_t bytes);
+
+    int fd_;
+    WALOptions options_;
+    // framed records not yet handed to the OS
+    BufferWriter pending_;
+    size_t pendingRecords_;
+    size_t groupsSinceSync_;
+
+private:
+    WriteAheadLog(const WriteAheadLog &);
+    WriteAheadLog &operator=(const WriteAheadLog &);
+};
+
+/**
+ * An AVLTree map whose mutations go through a write-ahead log, with
+ * snapshot checkpoints.
+ *
+ * Every checkpoint takes the next epoch number. checkpoint() writes a full
+ * base snapshot; checkpointDelta() writes only the keys inserted, updated
+ * or removed since the last checkpoint of either kind, to
+ * <snapshot>.delta.<epoch>, with tombstones for removed keys. compact()
+ * folds the deltas into a new base by merging the files, without the
+ * in-memory tree. The base records the last epoch it covers, so deltas
+ * at or below it are stale.
+ *
+ * Opening one recovers the state left by the last run: load the base if
+ * there is one, apply the newer deltas in epoch order, replay the log on
+ * top and cut off any torn tail. Replaying insert (overwrite), remove and
+ * delta entries is idempotent in map mode, so a crash between writing a
+ * checkpoint and emptying the log is harmless.
+ *
+ * Only one DurableAVLTree may own a snapshot and log at a time. Recovery,
+ * checkpoints and compaction each hold <snapshot>.lock while they read or
+ * replace the checkpoint files, so the static compact() can run from
+ * another process beside the owner.
+ */
+template <typename Key, typename Value,
+          typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+class DurableAVLTree
+{
+public:
+    typedef WriteAheadLog<Key, Value, KeyCodec, ValueCodec> Log;
+
+    DurableAVLTree(const std::string &snapshotPath, const std::string &logPath,
+                   const WALOptions &options = WALOptions());
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    void remove(const Key &key);
+    // makes every mutation so far durable
+    void commit();
+    // writes a fresh base snapshot (atomically, via rename), deletes the
+    // deltas and empties the log
+    void checkpoint();
+    // writes only what changed since the last checkpoint, then empties
+    // the log; costs O(changes), not O(size)
+    void checkpointDelta();
+    // folds the base and its deltas into a new base and deletes the deltas
+    void compact();
+    // the same, on the files alone, e.g. from another process (it waits
+    // for the owner's checkpoint to finish); returns the number of deltas
+    // folded in
+    static size_t compact(const std::string &snapshotPath);
+
+    const AVLTree<Key, Value> &tree() const;
+    // log records replayed when this object was opened
+    size_t recoveredRecords() const;
+    // keys that the next delta checkpoint would write
+    size_t dirtyCount() const;
+    // the epoch of the most recent checkpoint
+    uint32_t epoch() const;
+
+protected:
+    // loads and replays into tree_ and returns the log path, so log_ is
+    // only opened once the file is cut back to whole records
+    const std::string &recover();
+
+    static std::string deltaPath(const std::string &snapshotPath, uint32_t epoch);
+    static std::string lockPath(const std::string &snapshotPath);
+    static bool exists(const std::string &path);
+    // applies one delta file to tree
+    static void applyDelta(const std::string &path, AVLTree<Key, Value> &tree);
+    void writeDelta(const std::string &path, uint32_t epoch) const;
+
+    // counts what replay() applies; replayed keys are not in any
+    // checkpoint yet, so they are dirty
+    struct CountingTree
+    {
+        AVLTree<Key, Value> *tree;
+        AVLSet<Key> *dirty;
+        size_t records;
+        void insert(const std::pair<const Key, Value> &keyValuePair);
+        void remove(const Key &key);
+    };
+
+    // one input of compact(): the base or a delta, read an entry at a time
+    struct MergeSource
+    {
+        SnapshotReader *in;
+        bool isDelta;
+        uint64_t left;
+        bool has;
+        bool live;
+        Key key;
+        Value value;
+        void next();
+    };
+
+    std::string snapshotPath_;
+    std::string logPath_;
+    AVLTree<Key, Value> tree_;
+    // keys changed since the last checkpoint
+    AVLSet<Key> dirty_;
+    uint32_t epoch_;
+    size_t recovered_;
+    Log log_;
+};
+
+/*
+---------------------------------------------------
+Begin implementations for the WriteAheadLog class.
+---------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+WALHeader WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::makeHeader()
+{
+    WALHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+    header.version = WAL_VERSION;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    return header;
+}
+
+/**
+ * A new or empty file gets its header straight away, synced along with
+ * its directory entry, so replay() can always tell a log of the wrong
+ * types from a torn one.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::WriteAheadLog(const std::string &path, const WALOptions &options)
+    : options_(options), pendingRecords_(0), groupsSinceSync_(0)
+{
+    if (options_.groupSize == 0)
+    {
+        throw std::invalid_argument("groupSize must be at least 1");
+    }
+    fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("Cannot open " + path + " for appending");
+    }
+    struct stat info;
+    if (::fstat(fd_, &info) != 0)
+    {
+        ::close(fd_);
+        throw std::runtime_error("Cannot open " + path + " for appending");
+    }
+    if (info.st_size == 0)
+    {
+        try
+        {
+            WALHeader header = makeHeader();
+            writeAll(reinterpret_cast<const char *>(&header), sizeof(header));
+            if (::fsync(fd_) != 0)
+            {
+                throw std::runtime_error("Log sync failed");
+            }
+            syncParentDirectory(path);
+        }
+        catch (...)
+        {
+            ::close(fd_);
+            throw;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::~WriteAheadLog()
+{
+    try
+    {
+        writeOut();
+    }
+    catch (...)
+    {
+        // nothing more can be done from a destructor
+    }
+    ::close(fd_);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+uint32_t WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::checksum(const char *data, size_t bytes)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::logInsert(const Key &key, const Value &value)
+{
+    size_t start = beginRecord(WAL_INSERT);
+    KeyCodec::write(pending_, key);
+    ValueCodec::write(pending_, value);
+    endRecord(start);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::logRemove(const Key &key)
+{
+    size_t start = beginRecord(WAL_REMOVE);
+    KeyCodec::write(pending_, key);
+    endRecord(start);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::beginRecord(uint8_t type)
+{
+    size_t start = pending_.bytes_.size();
+    pending_.bytes_.resize(start + 2 * sizeof(uint32_t));
+    pending_.write(&type, sizeof(type));
+    return start;
+}
+
+/**
+ * Frames the record that starts at start, and writes the group out
+ * (syncing if it is time) once it is full.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::endRecord(size_t start)
+{
+    char *record = &pending_.bytes_[start];
+    uint32_t frame[2];
+    frame[0] = (uint32_t)(pending_.bytes_.size() - start - sizeof(frame));
+    frame[1] = checksum(record + sizeof(frame), frame[0]);
+    std::memcpy(record, frame, sizeof(frame));
+    pendingRecords_++;
+    if (pendingRecords_ < options_.groupSize)
+    {
+        return;
+    }
+    writeOut();
+    groupsSinceSync_++;
+    if (options_.syncEvery != 0 && groupsSinceSync_ >= options_.syncEvery)
+    {
+        if (::fsync(fd_) != 0)
+        {
+            throw std::runtime_error("Log sync failed");
+        }
+        groupsSinceSync_ = 0;
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::writeAll(const char *data, size_t bytes)
+{
+    while (bytes > 0)
+    {
+        ssize_t done = ::write(fd_, data, bytes);
+        if (done < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Log write failed");
+        }
+        data += done;
+        bytes -= (size_t)done;
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::writeOut()
+{
+    if (pending_.bytes_.empty())
+    {
+        return;
+    }
+    writeAll(&pending_.bytes_[0], pending_.bytes_.size());
+    pending_.bytes_.clear();
+    pendingRecords_ = 0;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::commit()
+{
+    writeOut();
+    if (::fsync(fd_) != 0)
+    {
+        throw std::runtime_error("Log sync failed");
+    }
+    groupsSinceSync_ = 0;
+}
+
+/**
+ * Drops queued records too: the caller has just saved a state that
+ * includes them.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::reset()
+{
+    pending_.bytes_.clear();
+    pendingRecords_ = 0;
+    groupsSinceSync_ = 0;
+    WALHeader header = makeHeader();
+    if (::ftruncate(fd_, 0) != 0)
+    {
+        throw std::runtime_error("Log truncate failed");
+    }
+    writeAll(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (::fsync(fd_) != 0)
+    {
+        throw std::runtime_error("Log sync failed");
+    }
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+template <typename Tree>
+size_t WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::replay(const std::string &path, Tree &tree)
+{
+    if (::access(path.c_str(), F_OK) != 0)
+    {
+        return 0;
+    }
+    SnapshotReader in(path);
+    WALHeader header;
+    try
+    {
+        in.read(&header, sizeof(header));
+    }
+    catch (std::runtime_error &)
+    {
+        // the header write itself was torn
+        return 0;
+    }
+    WALHeader expected = makeHeader();
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0)
+    {
+        throw std::runtime_error(path + " is not a log for these key and value types");
+    }
+
+    size_t valid = sizeof(header);
+    std::vector<char> payload;
+    while (!in.atEnd())
+    {
+        uint32_t frame[2];
+        try
+        {
+            in.read(frame, sizeof(frame));
+            // a garbage length from a torn frame must not be allocated
+            if (frame[0] > in.remaining())
+            {
+                break;
+            }
+            payload.resize(frame[0]);
+            if (frame[0] > 0)
+            {
+                in.read(&payload[0], frame[0]);
+            }
+        }
+        catch (std::runtime_error &)
+        {
+            break;
+        }
+        if (frame[0] == 0 || checksum(&payload[0], frame[0]) != frame[1])
+        {
+            break;
+        }
+
+        BufferReader record(&payload[0], payload.size());
+        uint8_t type;
+        record.read(&type, sizeof(type));
+        Key key;
+        KeyCodec::read(record, key);
+        if (type == WAL_INSERT)
+        {
+            Value value;
+            ValueCodec::read(record, value);
+            tree.insert(std::pair<const Key, Value>(key, value));
+        }
+        else if (type == WAL_REMOVE)
+        {
+            tree.remove(key);
+        }
+        else
+        {
+            throw std::runtime_error(path + " has an unknown record type");
+        }
+        valid += sizeof(frame) + frame[0];
+    }
+    return valid;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void WriteAheadLog<Key, Value, KeyCodec, ValueCodec>::truncate(const std::string &path, size_t validBytes)
+{
+    if (::truncate(path.c_str(), (off_t)validBytes) != 0)
+    {
+        throw std::runtime_error("Cannot truncate " + path);
+    }
+}
+
+/*
+----------------------------------------------------
+Begin implementations for the DurableAVLTree class.
+----------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::CountingTree::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    tree->insert(keyValuePair);
+    dirty->insert(keyValuePair.first);
+    records++;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::CountingTree::remove(const Key &key)
+{
+    tree->remove(key);
+    dirty->insert(key);
+    records++;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+std::string DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::deltaPath(const std::string &snapshotPath, uint32_t epoch)
+{
+    return snapshotPath + ".delta." + std::to_string(epoch);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+std::string DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::lockPath(const std::string &snapshotPath)
+{
+    return snapshotPath + ".lock";
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+bool DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::exists(const std::string &path)
+{
+    return ::access(path.c_str(), F_OK) == 0;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::applyDelta(const std::string &path, AVLTree<Key, Value> &tree)
+{
+    SnapshotReader in(path);
+    SnapshotHeader header;
+    in.read(&header, sizeof(header));
+    if (std::memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) != 0)
+    {
+        throw std::runtime_error(path + " is not a delta checkpoint");
+    }
+    MergeSource source;
+    source.in = &in;
+    source.isDelta = true;
+    source.left = header.count;
+    for (source.next(); source.has; source.next())
+    {
+        if (source.live)
+        {
+            tree.insert(std::pair<const Key, Value>(source.key, source.value));
+        }
+        else
+        {
+            tree.remove(source.key);
+        }
+    }
+}
+
+/**
+ * Runs from the constructor's initializer list, after every member but
+ * log_ is set up.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+const std::string &DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::recover()
+{
+    FileLock lock(lockPath(snapshotPath_));
+    uint32_t base = 0;
+    if (exists(snapshotPath_))
+    {
+        tree_.template load<KeyCodec, ValueCodec>(snapshotPath_);
+        base = readSnapshotHeader(snapshotPath_).epoch;
+    }
+    // deltas the base already covers, left by a crash during checkpoint()
+    // or compact()
+    for (uint32_t stale = base; stale > 0 && exists(deltaPath(snapshotPath_, stale)); stale--)
+    {
+        std::remove(deltaPath(snapshotPath_, stale).c_str());
+    }
+    epoch_ = base;
+    while (exists(deltaPath(snapshotPath_, epoch_ + 1)))
+    {
+        applyDelta(deltaPath(snapshotPath_, epoch_ + 1), tree_);
+        epoch_++;
+    }
+
+    CountingTree counting;
+    counting.tree = &tree_;
+    counting.dirty = &dirty_;
+    counting.records = 0;
+    size_t valid = Log::replay(logPath_, counting);
+    if (exists(logPath_))
+    {
+        // a torn header leaves valid at 0, and the log starts over
+        Log::truncate(logPath_, valid);
+    }
+    recovered_ = counting.records;
+    return logPath_;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::DurableAVLTree(const std::string &snapshotPath, const std::string &logPath,
+                                                                const WALOptions &options)
+    : snapshotPath_(snapshotPath), logPath_(logPath), epoch_(0), recovered_(0), log_(recover(), options)
+{
+}
+
+/**
+ * Logs first, so the tree never holds a change the log has not seen.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    log_.logInsert(keyValuePair.first, keyValuePair.second);
+    tree_.insert(keyValuePair);
+    dirty_.insert(keyValuePair.first);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::remove(const Key &key)
+{
+    log_.logRemove(key);
+    tree_.remove(key);
+    dirty_.insert(key);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::commit()
+{
+    log_.commit();
+}
+
+/**
+ * The snapshot goes to a temporary file that is synced and then renamed
+ * over the old one, so a crash leaves either snapshot whole. The deltas
+ * and the log are only dropped once publishFile() has synced the rename:
+ * until then a crash can bring back the old snapshot.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::checkpoint()
+{
+    FileLock lock(lockPath(snapshotPath_));
+    uint32_t epoch = epoch_ + 1;
+    std::string temp = snapshotPath_ + ".tmp";
+    tree_.template save<KeyCodec, ValueCodec>(temp);
+    SnapshotHeader header = readSnapshotHeader(temp);
+    header.epoch = epoch;
+    writeSnapshotHeader(temp, header);
+    publishFile(temp, snapshotPath_);
+    for (uint32_t stale = epoch_; stale > 0 && exists(deltaPath(snapshotPath_, stale)); stale--)
+    {
+        std::remove(deltaPath(snapshotPath_, stale).c_str());
+    }
+    epoch_ = epoch;
+    dirty_.clear();
+    log_.reset();
+}
+
+/**
+ * Walks the dirty keys in order and looks each one up: a key no longer
+ * in the tree becomes a tombstone.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::writeDelta(const std::string &path, uint32_t epoch) const
+{
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.epoch = epoch;
+    header.count = dirty_.size();
+
+    SnapshotWriter out(path);
+    out.write(&header, sizeof(header));
+    for (typename AVLSet<Key>::iterator it = dirty_.begin(); it != dirty_.end(); ++it)
+    {
+        typename AVLTree<Key, Value>::iterator found = tree_.find(*it);
+        uint8_t live = (found != tree_.end()) ? 1 : 0;
+        out.write(&live, sizeof(live));
+        KeyCodec::write(out, *it);
+        if (live)
+        {
+            ValueCodec::write(out, found->second);
+        }
+    }
+    out.close();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::checkpointDelta()
+{
+    FileLock lock(lockPath(snapshotPath_));
+    uint32_t epoch = epoch_ + 1;
+    std::string path = deltaPath(snapshotPath_, epoch);
+    writeDelta(path + ".tmp", epoch);
+    publishFile(path + ".tmp", path);
+    epoch_ = epoch;
+    dirty_.clear();
+    log_.reset();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::MergeSource::next()
+{
+    if (left == 0)
+    {
+        has = false;
+        return;
+    }
+    left--;
+    has = true;
+    live = true;
+    if (isDelta)
+    {
+        uint8_t flag;
+        in->read(&flag, sizeof(flag));
+        live = (flag != 0);
+    }
+    KeyCodec::read(*in, key);
+    if (live)
+    {
+        ValueCodec::read(*in, value);
+    }
+}
+
+/**
+ * A k-way merge of the base and the deltas, all in key order. Where
+ * several hold the same key the newest epoch wins, and a winning
+ * tombstone drops the key. The count is only known at the end, so the
+ * header is rewritten then.
+ *
+ * The lock is held from reading the base epoch to deleting the folded
+ * deltas: without it a checkpoint() by the owner in between would be
+ * overwritten by this older base after its log was already emptied.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::compact(const std::string &snapshotPath)
+{
+    FileLock lock(lockPath(snapshotPath));
+    uint32_t base = exists(snapshotPath) ? readSnapshotHeader(snapshotPath).epoch : 0;
+    uint32_t last = base;
+    while (exists(deltaPath(snapshotPath, last + 1)))
+    {
+        last++;
+    }
+    if (last == base)
+    {
+        return 0;
+    }
+
+    // sources[0] is the base (possibly empty), then epochs base+1..last
+    std::vector<SnapshotReader *> readers;
+    std::vector<MergeSource> sources(last - base + 1);
+    std::string temp = snapshotPath + ".tmp";
+    uint64_t count = 0;
+    try
+    {
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            std::string path = (i == 0) ? snapshotPath : deltaPath(snapshotPath, base + (uint32_t)i);
+            sources[i].isDelta = (i != 0);
+            sources[i].left = 0;
+            if (i == 0 && base == 0 && !exists(path))
+            {
+                sources[i].in = nullptr;
+                sources[i].has = false;
+                continue;
+            }
+            readers.push_back(new SnapshotReader(path));
+            sources[i].in = readers.back();
+            SnapshotHeader header;
+            sources[i].in->read(&header, sizeof(header));
+            if (std::memcmp(header.magic, (i == 0) ? SNAPSHOT_MAGIC : DELTA_MAGIC, sizeof(header.magic)) != 0 ||
+                header.keySize != sizeof(Key) || header.valueSize != sizeof(Value))
+            {
+                throw std::runtime_error(path + " does not match this tree");
+            }
+            sources[i].left = header.count;
+            sources[i].next();
+        }
+
+        SnapshotHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.keySize = sizeof(Key);
+        header.valueSize = sizeof(Value);
+        header.epoch = last;
+        {
+            SnapshotWriter out(temp);
+            out.write(&header, sizeof(header));
+            while (true)
+            {
+                MergeSource *winner = nullptr;
+                for (size_t i = 0; i < sources.size(); i++)
+                {
+                    if (sources[i].has && (winner == nullptr || !(winner->key < sources[i].key)))
+                    {
+                        // ties go to the later, newer source
+                        winner = &sources[i];
+                    }
+                }
+                if (winner == nullptr)
+                {
+                    break;
+                }
+                if (winner->live)
+                {
+                    KeyCodec::write(out, winner->key);
+                    ValueCodec::write(out, winner->value);
+                    count++;
+                }
+                Key done = winner->key;
+                for (size_t i = 0; i < sources.size(); i++)
+                {
+                    if (sources[i].has && !(done < sources[i].key))
+                    {
+                        sources[i].next();
+                    }
+                }
+            }
+            out.close();
+        }
+        header.count = count;
+        writeSnapshotHeader(temp, header);
+    }
+    catch (...)
+    {
+        for (size_t i = 0; i < readers.size(); i++)
+        {
+            delete readers[i];
+        }
+        std::remove(temp.c_str());
+        throw;
+    }
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        delete readers[i];
+    }
+
+    publishFile(temp, snapshotPath);
+    for (uint32_t epoch = base + 1; epoch <= last; epoch++)
+    {
+        std::remove(deltaPath(snapshotPath, epoch).c_str());
+    }
+    return last - base;
+}
+
+/**
+ * The in-memory tree, the dirty set and the log are untouched: the new
+ * base holds exactly what the old base and the deltas did.
+ */
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::compact()
+{
+    compact(snapshotPath_);
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+const AVLTree<Key, Value> &DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::tree() const
+{
+    return tree_;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::recoveredRecords() const
+{
+    return recovered_;
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+size_t DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::dirtyCount() const
+{
+    return dirty_.size();
+}
+
+template <typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+uint32_t DurableAVLTree<Key, Value, KeyCodec, ValueCodec>::epoch() const
+{
+    return epoch_;
+}
+
+#endif